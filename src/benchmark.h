@@ -0,0 +1,298 @@
+//
+//  benchmark.h
+//  3D Object Drawing
+//
+//  Deterministic frame benchmark: a scripted camera path replayed with a
+//  fixed timestep, per-frame CPU/GPU time and API counters, and a JSON
+//  report of their percentiles so runs can be compared between commits.
+//
+
+#ifndef benchmark_h
+#define benchmark_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "basic_camera.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+// camera state at one point in time
+struct CameraKeyframe
+{
+    float time;
+    glm::vec3 position;
+    float yaw, pitch, roll;
+};
+
+// piecewise linear camera path, one keyframe per line:
+//   time posX posY posZ yaw pitch roll
+// blank lines and lines starting with '#' are ignored
+class CameraPath
+{
+public:
+    std::vector<CameraKeyframe> keyframes;
+
+    bool load(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERA_PATH: cannot read " << path << std::endl;
+            return false;
+        }
+
+        keyframes.clear();
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            lineNumber++;
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            CameraKeyframe key;
+            if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch >> key.roll))
+            {
+                std::cout << "ERROR::CAMERA_PATH: " << path << ":" << lineNumber << ": expected 7 numbers" << std::endl;
+                return false;
+            }
+            if (!keyframes.empty() && key.time <= keyframes.back().time)
+            {
+                std::cout << "ERROR::CAMERA_PATH: " << path << ":" << lineNumber << ": times must increase" << std::endl;
+                return false;
+            }
+            keyframes.push_back(key);
+        }
+
+        if (keyframes.empty())
+        {
+            std::cout << "ERROR::CAMERA_PATH: " << path << " has no keyframes" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    float duration() const
+    {
+        return keyframes.empty() ? 0.0f : keyframes.back().time;
+    }
+
+    // place the camera at the interpolated state for the given time
+    void apply(BasicCamera& camera, float time) const
+    {
+        size_t next = 0;
+        while (next < keyframes.size() && keyframes[next].time < time)
+            next++;
+
+        CameraKeyframe key;
+        if (next == 0)
+            key = keyframes.front();
+        else if (next == keyframes.size())
+            key = keyframes.back();
+        else
+        {
+            const CameraKeyframe& a = keyframes[next - 1];
+            const CameraKeyframe& b = keyframes[next];
+            float t = (time - a.time) / (b.time - a.time);
+            key.position = glm::mix(a.position, b.position, t);
+            key.yaw = glm::mix(a.yaw, b.yaw, t);
+            key.pitch = glm::mix(a.pitch, b.pitch, t);
+            key.roll = glm::mix(a.roll, b.roll, t);
+        }
+
+        camera.Position = key.position;
+        camera.Yaw = key.yaw;
+        camera.Pitch = key.pitch;
+        camera.Roll = key.roll;
+        camera.updateCameraVectors();
+    }
+};
+
+// GPU time of whole frames through GL_TIME_ELAPSED queries; results are read
+// a few frames later so the CPU never waits for them
+class GpuFrameTimer
+{
+public:
+    static const int LATENCY = 4;
+
+    // milliseconds per frame number; frames without a result stay negative
+    std::vector<double> frameMs;
+
+    GpuFrameTimer()
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    ~GpuFrameTimer()
+    {
+        release();
+    }
+
+    GpuFrameTimer(const GpuFrameTimer&) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+    void begin(unsigned int frame)
+    {
+        int slot = frame % LATENCY;
+        // the slot's previous query is LATENCY frames old; collect it before reuse
+        if (pending[slot])
+            collect(slot);
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+        frames[slot] = frame;
+        activeSlot = slot;
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[activeSlot] = true;
+    }
+
+    // fetch whatever is still in flight; call once after the last frame
+    void drain()
+    {
+        for (int slot = 0; slot < LATENCY; slot++)
+            if (pending[slot])
+                collect(slot);
+    }
+
+    void release()
+    {
+        if (queries[0] != 0)
+        {
+            glDeleteQueries(LATENCY, queries);
+            queries[0] = 0;
+        }
+    }
+
+private:
+    GLuint queries[LATENCY] = {};
+    unsigned int frames[LATENCY] = {};
+    bool pending[LATENCY] = {};
+    int activeSlot = 0;
+
+    void collect(int slot)
+    {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        if (frameMs.size() <= frames[slot])
+            frameMs.resize(frames[slot] + 1, -1.0);
+        frameMs[frames[slot]] = nanoseconds / 1.0e6;
+        pending[slot] = false;
+    }
+};
+
+// per-frame samples of one benchmark run
+struct BenchmarkFrame
+{
+    double cpuMs;
+    double submitMs; // CPU time spent handing the sorted draws to GL
+    unsigned int drawCalls;
+    unsigned int uniformUploads;
+    unsigned int stateChanges; // state calls the GL state cache let through
+};
+
+class BenchmarkReport
+{
+public:
+    std::vector<BenchmarkFrame> frames;
+
+    void addFrame(double cpuMs, double submitMs, unsigned int drawCalls, unsigned int uniformUploads, unsigned int stateChanges)
+    {
+        frames.push_back({cpuMs, submitMs, drawCalls, uniformUploads, stateChanges});
+    }
+
+    // frames before warmupFrames are excluded from every statistic
+    bool writeJSON(const char* path, const char* cameraPath, unsigned int warmupFrames, float timestep,
+                   const std::vector<double>& gpuFrameMs) const
+    {
+        std::vector<double> cpu, submit, gpu, draws, uploads, states;
+        for (size_t i = warmupFrames; i < frames.size(); i++)
+        {
+            cpu.push_back(frames[i].cpuMs);
+            submit.push_back(frames[i].submitMs);
+            draws.push_back(frames[i].drawCalls);
+            uploads.push_back(frames[i].uniformUploads);
+            states.push_back(frames[i].stateChanges);
+            if (i < gpuFrameMs.size() && gpuFrameMs[i] >= 0.0)
+                gpu.push_back(gpuFrameMs[i]);
+        }
+
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK: cannot write " << path << std::endl;
+            return false;
+        }
+        file << "{\n";
+        file << "  \"cameraPath\": \"" << cameraPath << "\",\n";
+        file << "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n";
+        file << "  \"version\": \"" << glString(GL_VERSION) << "\",\n";
+        file << "  \"timestep\": " << timestep << ",\n";
+        file << "  \"warmupFrames\": " << warmupFrames << ",\n";
+        file << "  \"frames\": " << cpu.size() << ",\n";
+        writeStats(file, "cpuFrameMs", cpu);
+        file << ",\n";
+        writeStats(file, "cpuSubmitMs", submit);
+        file << ",\n";
+        writeStats(file, "gpuFrameMs", gpu);
+        file << ",\n";
+        writeStats(file, "drawCalls", draws);
+        file << ",\n";
+        writeStats(file, "uniformUploads", uploads);
+        file << ",\n";
+        writeStats(file, "stateChanges", states);
+        file << "\n}\n";
+        return true;
+    }
+
+    // nearest-rank percentile of sorted samples
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+
+private:
+    static std::string glString(GLenum name)
+    {
+        const char* value = (const char*)glGetString(name);
+        std::string escaped;
+        for (const char* c = value ? value : ""; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                escaped += '\\';
+            escaped += *c;
+        }
+        return escaped;
+    }
+
+    static void writeStats(std::ofstream& file, const char* name, std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        file << "  \"" << name << "\": {";
+        file << "\"p50\": " << percentile(samples, 50.0);
+        file << ", \"p95\": " << percentile(samples, 95.0);
+        file << ", \"p99\": " << percentile(samples, 99.0);
+        file << ", \"mean\": " << (samples.empty() ? 0.0 : sum / samples.size());
+        file << ", \"min\": " << (samples.empty() ? 0.0 : samples.front());
+        file << ", \"max\": " << (samples.empty() ? 0.0 : samples.back());
+        file << ", \"samples\": " << samples.size() << "}";
+    }
+};
+
+#endif /* benchmark_h */
@@ -0,0 +1,107 @@
+//
+//  bounds.h
+//  3D Object Drawing
+//
+//  Bounding volumes: an axis-aligned box and a sphere sharing one center,
+//  and a structure-of-arrays container the frustum test reads four at a time.
+//
+
+#ifndef bounds_h
+#define bounds_h
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// box half extents and sphere radius around the same center
+struct Bounds
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// bounds of a vertex array; the sphere is centered on the box so both volumes
+// can be tested against a plane with one distance
+inline Bounds computeBounds(const float* vertices, size_t vertexCount, size_t stride)
+{
+    Bounds bounds;
+    if (vertexCount == 0)
+        return bounds;
+
+    glm::vec3 minimum(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 maximum = minimum;
+    for (size_t i = 1; i < vertexCount; i++)
+    {
+        glm::vec3 position(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    bounds.center = (minimum + maximum) * 0.5f;
+    bounds.extent = (maximum - minimum) * 0.5f;
+
+    float radiusSquared = 0.0f;
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        glm::vec3 position(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+        glm::vec3 offset = position - bounds.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.radius = std::sqrt(radiusSquared);
+    return bounds;
+}
+
+// world-space bounds of a local volume; the box stays axis aligned (Arvo) and
+// the sphere grows with the largest axis scale
+inline Bounds transformBounds(const Bounds& local, const glm::mat4& world)
+{
+    Bounds result;
+    result.center = glm::vec3(world * glm::vec4(local.center, 1.0f));
+    glm::mat3 linear(world);
+    glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+    result.extent = absolute * local.extent;
+    float scale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+    result.radius = local.radius * scale;
+    return result;
+}
+
+// many bounds in structure-of-arrays form, padded to a multiple of four
+struct BoundsSoA
+{
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+    size_t count = 0;
+
+    void resize(size_t newCount)
+    {
+        count = newCount;
+        size_t padded = (newCount + 3) & ~(size_t)3;
+        for (std::vector<float>* column : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius})
+            column->resize(padded, 0.0f);
+    }
+
+    void set(size_t i, const Bounds& bounds)
+    {
+        centerX[i] = bounds.center.x;
+        centerY[i] = bounds.center.y;
+        centerZ[i] = bounds.center.z;
+        extentX[i] = bounds.extent.x;
+        extentY[i] = bounds.extent.y;
+        extentZ[i] = bounds.extent.z;
+        radius[i] = bounds.radius;
+    }
+
+    Bounds get(size_t i) const
+    {
+        Bounds bounds;
+        bounds.center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+        bounds.extent = glm::vec3(extentX[i], extentY[i], extentZ[i]);
+        bounds.radius = radius[i];
+        return bounds;
+    }
+};
+
+#endif /* bounds_h */
@@ -0,0 +1,368 @@
+//
+//  buffer_arena.h
+//  3D Object Drawing
+//
+//  One large GL buffer handed out in offset ranges. Free space is a list of
+//  ranges sorted by offset; an allocation takes the best fitting range that
+//  still fits after rounding its start up to the requested alignment, and a
+//  freed range is merged with its neighbours. Any alignment works, so vertex
+//  data can be aligned to its stride and addressed by base vertex.
+//
+//  Allocations are named by ids that stay valid for their lifetime. A full
+//  arena grows in place (the buffer name stays, so VAOs stay valid), and
+//  defragment() packs the live ranges to the front; both go through
+//  glCopyBufferSubData and never read the data back to the CPU. Only
+//  defragment() moves ranges; it bumps version so users can re-query offsets.
+//
+
+#ifndef buffer_arena_h
+#define buffer_arena_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+// data rewritten every frame is kept in this many copies, so the CPU writes one
+// while the GPU may still read the previous ones
+const int STREAM_FRAME_REGIONS = 3;
+
+class BufferArena
+{
+public:
+    static const unsigned int INVALID = 0xFFFFFFFF;
+
+    GLuint buffer = 0;
+    char* mapped = NULL;      // persistent, coherent write mapping of the whole buffer, or NULL
+    unsigned int version = 0; // bumped whenever defragment() moves allocations
+
+    // statistics
+    GLsizeiptr capacity = 0;
+    GLsizeiptr bytesUsed = 0; // allocated sizes, without alignment padding
+    GLsizeiptr peakBytesUsed = 0;
+    GLsizeiptr bytesMoved = 0; // by defragment()
+    unsigned int liveAllocations = 0;
+    unsigned int allocations = 0;
+    unsigned int frees = 0;
+    unsigned int failures = 0;
+    unsigned int grows = 0;
+    unsigned int defragmentations = 0;
+
+    // persistent: map the buffer for writing where ARB_buffer_storage exists; the
+    // storage is immutable then, so the arena can't grow
+    BufferArena(GLsizeiptr initialCapacity, GLenum usage, bool persistent = false) : usage(usage)
+    {
+        capacity = initialCapacity;
+        glGenBuffers(1, &buffer);
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (persistent && glExtensions.bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExtensions.BufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, flags | GL_DYNAMIC_STORAGE_BIT);
+            mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+            immutable = true;
+            if (mapped == NULL)
+            {
+                // storage is immutable now, start over with a fresh buffer
+                glState.forgetBuffer(buffer);
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                immutable = false;
+            }
+        }
+        if (!immutable)
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, usage);
+        freeRanges.push_back({0, capacity});
+    }
+
+    ~BufferArena()
+    {
+        release();
+    }
+
+    BufferArena(const BufferArena&) = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    // id of a new range of size bytes whose offset is a multiple of alignment, or INVALID
+    unsigned int allocate(GLsizeiptr size, GLsizeiptr alignment = 4)
+    {
+        if (size <= 0 || alignment <= 0)
+            return INVALID;
+
+        GLintptr offset = 0;
+        int range = findRange(size, alignment, offset);
+        if (range < 0 && grow(size + alignment))
+            range = findRange(size, alignment, offset);
+        if (range < 0)
+        {
+            failures++;
+            std::cout << "WARNING::BUFFER_ARENA: no room for " << size << " bytes (" << capacity - bytesUsed << " free in "
+                      << freeRanges.size() << " ranges)" << std::endl;
+            return INVALID;
+        }
+
+        // split the range around the allocation; the alignment padding stays free
+        Range taken = freeRanges[range];
+        freeRanges.erase(freeRanges.begin() + range);
+        GLintptr end = offset + size;
+        if (end < taken.offset + taken.size)
+            freeRanges.insert(freeRanges.begin() + range, {end, taken.offset + taken.size - end});
+        if (offset > taken.offset)
+            freeRanges.insert(freeRanges.begin() + range, {taken.offset, offset - taken.offset});
+
+        unsigned int id;
+        if (!freeIds.empty())
+        {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        else
+        {
+            id = (unsigned int)records.size();
+            records.push_back({});
+        }
+        records[id] = {offset, size, alignment, true};
+
+        bytesUsed += size;
+        peakBytesUsed = std::max(peakBytesUsed, bytesUsed);
+        liveAllocations++;
+        allocations++;
+        return id;
+    }
+
+    void free(unsigned int id)
+    {
+        if (id >= records.size() || !records[id].live)
+            return;
+        Record& record = records[id];
+        record.live = false;
+        bytesUsed -= record.size;
+        liveAllocations--;
+        frees++;
+        freeIds.push_back(id);
+        insertFree({record.offset, record.size});
+    }
+
+    GLintptr offset(unsigned int id) const
+    {
+        return records[id].offset;
+    }
+
+    GLsizeiptr size(unsigned int id) const
+    {
+        return records[id].size;
+    }
+
+    GLsizeiptr largestFreeRange() const
+    {
+        GLsizeiptr largest = 0;
+        for (const Range& range : freeRanges)
+            largest = std::max(largest, range.size);
+        return largest;
+    }
+
+    // 0 when the free space is one range, towards 1 as it splinters
+    float fragmentation() const
+    {
+        GLsizeiptr available = capacity - bytesUsed;
+        return available > 0 ? 1.0f - (float)largestFreeRange() / (float)available : 0.0f;
+    }
+
+    // write into an allocation; offset is relative to its start
+    void write(unsigned int id, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, records[id].offset + offset, size, data);
+    }
+
+    // pack the live allocations to the front in offset order; returns false if nothing moved.
+    // Offsets change, so every user has to re-query them afterwards (see version)
+    bool defragment()
+    {
+        std::vector<unsigned int> live;
+        for (unsigned int id = 0; id < records.size(); id++)
+            if (records[id].live)
+                live.push_back(id);
+        std::sort(live.begin(), live.end(), [&](unsigned int a, unsigned int b)
+                  { return records[a].offset < records[b].offset; });
+
+        std::vector<GLintptr> packed(live.size());
+        std::vector<Range> gaps; // alignment padding between packed ranges
+        GLintptr end = 0;
+        bool moved = false;
+        for (size_t i = 0; i < live.size(); i++)
+        {
+            const Record& record = records[live[i]];
+            packed[i] = alignUp(end, record.alignment);
+            if (packed[i] > end)
+                gaps.push_back({end, packed[i] - end});
+            end = packed[i] + record.size;
+            moved = moved || packed[i] != record.offset;
+        }
+        if (!moved)
+            return false;
+
+        // stage the packed layout in a scratch buffer, then copy it back in one piece
+        GLuint scratch = createScratch(end);
+        glState.bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        for (size_t i = 0; i < live.size(); i++)
+        {
+            Record& record = records[live[i]];
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, record.offset, packed[i], record.size);
+            if (packed[i] != record.offset)
+                bytesMoved += record.size;
+            record.offset = packed[i];
+        }
+        copyBack(scratch, end);
+
+        freeRanges = gaps;
+        if (end < capacity)
+            freeRanges.push_back({end, capacity - end});
+        defragmentations++;
+        version++;
+        return true;
+    }
+
+    void printStats(const char* name) const
+    {
+        std::cout << name << ": " << bytesUsed / 1024.0 << " of " << capacity / 1024.0 << " KB used (peak " << peakBytesUsed / 1024.0
+                  << "), " << liveAllocations << " allocations, " << freeRanges.size() << " free ranges, "
+                  << fragmentation() * 100.0f << "% fragmented, " << grows << " grows, " << defragmentations << " defragmentations"
+                  << std::endl;
+    }
+
+    // free the buffer; needs a current GL context
+    void release()
+    {
+        if (buffer != 0)
+        {
+            if (mapped != NULL)
+            {
+                glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                mapped = NULL;
+            }
+            glState.forgetBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+        records.clear();
+        freeIds.clear();
+        freeRanges.clear();
+        capacity = bytesUsed = 0;
+        liveAllocations = 0;
+    }
+
+private:
+    struct Range
+    {
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct Record
+    {
+        GLintptr offset;
+        GLsizeiptr size;
+        GLsizeiptr alignment;
+        bool live;
+    };
+
+    GLenum usage;
+    bool immutable = false;
+    std::vector<Range> freeRanges; // sorted by offset, never adjacent
+    std::vector<Record> records;   // by allocation id
+    std::vector<unsigned int> freeIds;
+
+    static GLintptr alignUp(GLintptr offset, GLsizeiptr alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // best fit: the smallest free range the aligned allocation fits in
+    int findRange(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) const
+    {
+        int best = -1;
+        for (size_t i = 0; i < freeRanges.size(); i++)
+        {
+            const Range& range = freeRanges[i];
+            GLintptr aligned = alignUp(range.offset, alignment);
+            if (aligned + size > range.offset + range.size)
+                continue;
+            if (best < 0 || range.size < freeRanges[best].size)
+            {
+                best = (int)i;
+                offset = aligned;
+            }
+        }
+        return best;
+    }
+
+    void insertFree(Range range)
+    {
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), range.offset, [](const Range& r, GLintptr value)
+                                     { return r.offset < value; });
+        if (next != freeRanges.end() && range.offset + range.size == next->offset)
+        {
+            range.size += next->size;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = next - 1;
+            if (previous->offset + previous->size == range.offset)
+            {
+                previous->size += range.size;
+                return;
+            }
+        }
+        freeRanges.insert(next, range);
+    }
+
+    // double the buffer (at least by needed bytes) under the same name
+    bool grow(GLsizeiptr needed)
+    {
+        if (immutable)
+            return false;
+
+        GLsizeiptr oldCapacity = capacity;
+        GLuint scratch = createScratch(oldCapacity);
+        glState.bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity);
+
+        capacity = std::max(capacity * 2, capacity + needed);
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, usage);
+        copyBack(scratch, oldCapacity);
+
+        insertFree({oldCapacity, capacity - oldCapacity});
+        grows++;
+        return true;
+    }
+
+    // a temporary buffer bound as the copy destination
+    GLuint createScratch(GLsizeiptr size)
+    {
+        GLuint scratch = 0;
+        glGenBuffers(1, &scratch);
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_COPY);
+        return scratch;
+    }
+
+    void copyBack(GLuint scratch, GLsizeiptr size)
+    {
+        glState.bindBuffer(GL_COPY_READ_BUFFER, scratch);
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        glState.forgetBuffer(scratch);
+        glDeleteBuffers(1, &scratch);
+    }
+};
+
+#endif /* buffer_arena_h */
@@ -0,0 +1,425 @@
+//
+//  bvh.h
+//  3D Object Drawing
+//
+//  Bounding volume hierarchy over world-space Bounds. Built top-down with a
+//  binned surface area heuristic into one flat node array (children of a node
+//  are adjacent and always stored after it), refit bottom-up when only some
+//  objects moved, and traversed for frustum culling and ray queries.
+//
+
+#ifndef bvh_h
+#define bvh_h
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cassert>
+
+// 32 bytes; leaves have count > 0 and their items start at first,
+// inner nodes have count == 0 and their children at first and first + 1
+struct BVHNode
+{
+    glm::vec3 boundsMin;
+    int first;
+    glm::vec3 boundsMax;
+    int count;
+};
+
+class BVH
+{
+public:
+    static const int BINS = 8;
+    static const int MAX_LEAF_ITEMS = 2;
+    // nodes this deep become leaves whatever their item count, so a lopsided
+    // split sequence (e.g. objects lined up along one axis) can't outgrow the
+    // traversal stacks, which hold at most one entry per level plus one
+    static const int MAX_DEPTH = 48;
+
+    std::vector<BVHNode> nodes;
+    std::vector<int> items; // object indices, grouped by leaf
+
+    // statistics
+    unsigned int depth = 0;         // deepest leaf of the last build(), the root is 0
+    unsigned int nodesRefit = 0;    // nodes recomputed by the last refit()
+    unsigned int nodesVisited = 0;  // nodes touched by the last query
+    unsigned int visibleCount = 0;  // result of the last cull()
+    unsigned int culledCount = 0;
+
+    void build(const BoundsSoA& bounds)
+    {
+        size_t count = bounds.count;
+        items.resize(count);
+        itemMin.resize(count);
+        itemMax.resize(count);
+        centroids.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            items[i] = (int)i;
+            updateItem(bounds, (int)i);
+        }
+
+        nodes.clear();
+        nodes.reserve(count * 2);
+        parents.clear();
+        itemLeaves.assign(count, 0);
+        depth = 0;
+        if (count == 0)
+            return;
+
+        nodes.push_back(BVHNode());
+        parents.push_back(-1);
+        nodes[0].first = 0;
+        nodes[0].count = (int)count;
+        updateNodeBounds(0);
+        subdivide(0, 0);
+    }
+
+    // recompute the bounds of the listed objects and of every node above them
+    void refit(const BoundsSoA& bounds, const std::vector<int>& changed)
+    {
+        nodesRefit = 0;
+        if (changed.empty() || nodes.empty())
+            return;
+
+        dirtyNodes.assign(nodes.size(), 0);
+        for (int item : changed)
+        {
+            updateItem(bounds, item);
+            dirtyNodes[itemLeaves[item]] = 1;
+        }
+
+        // children are stored after their parent, so a reverse sweep sees
+        // every child before the node that encloses it
+        for (size_t n = nodes.size(); n-- > 0;)
+        {
+            if (!dirtyNodes[n])
+                continue;
+            updateNodeBounds((int)n);
+            nodesRefit++;
+            if (parents[n] >= 0)
+                dirtyNodes[parents[n]] = 1;
+        }
+    }
+
+    // visible[i] = 1 if object i may be visible; whole subtrees inside the
+    // frustum are accepted without testing their objects, the objects of
+    // intersecting leaves go through the frustum's four-wide test
+    void cull(const Frustum& frustum, const BoundsSoA& bounds, FrameVector<unsigned char>& visible)
+    {
+        visible.assign(bounds.centerX.size(), 0);
+        nodesVisited = 0;
+        visibleCount = 0;
+        if (nodes.empty())
+        {
+            culledCount = 0;
+            return;
+        }
+
+        // objects of leaves that straddle the frustum, tested together at the end
+        FrameVector<int> candidates(visible.get_allocator());
+        candidates.reserve(bounds.count);
+
+        // each entry carries the planes its parent was not yet fully inside
+        struct Entry
+        {
+            int node;
+            unsigned int planeMask;
+        };
+        Entry stack[MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = {0, 0x3f};
+        while (top > 0)
+        {
+            Entry entry = stack[--top];
+            const BVHNode& node = nodes[entry.node];
+            nodesVisited++;
+
+            unsigned int planeMask = entry.planeMask;
+            glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+            glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+            int side = frustum.classify(center, extent, planeMask);
+            if (side < 0)
+                continue;
+
+            if (side > 0)
+            {
+                markVisible(entry.node, visible);
+                continue;
+            }
+            if (node.count > 0)
+            {
+                candidates.insert(candidates.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+                continue;
+            }
+            assert(top + 2 <= MAX_DEPTH + 1);
+            stack[top++] = {node.first, planeMask};
+            stack[top++] = {node.first + 1, planeMask};
+        }
+        visibleCount += frustum.cull(bounds, candidates.data(), candidates.size(), visible);
+        culledCount = (unsigned int)bounds.count - visibleCount;
+    }
+
+    // closest object hit by origin + t * direction, t in [0, maxDistance];
+    // hitItem(item, t) refines the hit (e.g. against triangles) and returns
+    // false for a miss, updating t otherwise. Returns the item or -1.
+    template <typename ItemTest>
+    int raycast(const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, ItemTest hitItem)
+    {
+        nodesVisited = 0;
+        if (nodes.empty())
+            return -1;
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+        int hit = -1;
+        int stack[MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode& node = nodes[stack[--top]];
+            nodesVisited++;
+            if (rayBoxDistance(origin, inverseDirection, node.boundsMin, node.boundsMax) > maxDistance)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                {
+                    float distance = maxDistance;
+                    if (hitItem(items[i], distance) && distance <= maxDistance)
+                    {
+                        maxDistance = distance;
+                        hit = items[i];
+                    }
+                }
+                continue;
+            }
+
+            // visit the nearer child first so the farther one is often pruned
+            float left = rayBoxDistance(origin, inverseDirection, nodes[node.first].boundsMin, nodes[node.first].boundsMax);
+            float right = rayBoxDistance(origin, inverseDirection, nodes[node.first + 1].boundsMin, nodes[node.first + 1].boundsMax);
+            assert(top + 2 <= MAX_DEPTH + 1);
+            if (left < right)
+            {
+                stack[top++] = node.first + 1;
+                stack[top++] = node.first;
+            }
+            else
+            {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+        return hit;
+    }
+
+private:
+    std::vector<glm::vec3> itemMin, itemMax, centroids;
+    std::vector<int> parents;
+    std::vector<int> itemLeaves; // leaf node of each object
+    std::vector<unsigned char> dirtyNodes;
+
+    void updateItem(const BoundsSoA& bounds, int item)
+    {
+        Bounds b = bounds.get(item);
+        itemMin[item] = b.center - b.extent;
+        itemMax[item] = b.center + b.extent;
+        centroids[item] = b.center;
+    }
+
+    void updateNodeBounds(int index)
+    {
+        BVHNode& node = nodes[index];
+        node.boundsMin = glm::vec3(FLT_MAX);
+        node.boundsMax = glm::vec3(-FLT_MAX);
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                node.boundsMin = glm::min(node.boundsMin, itemMin[items[i]]);
+                node.boundsMax = glm::max(node.boundsMax, itemMax[items[i]]);
+            }
+        }
+        else
+        {
+            for (int child = node.first; child <= node.first + 1; child++)
+            {
+                node.boundsMin = glm::min(node.boundsMin, nodes[child].boundsMin);
+                node.boundsMax = glm::max(node.boundsMax, nodes[child].boundsMax);
+            }
+        }
+    }
+
+    static float area(const glm::vec3& minimum, const glm::vec3& maximum)
+    {
+        glm::vec3 size = maximum - minimum;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    // binned SAH: returns the cost of the best split and its axis/position
+    float findSplit(const BVHNode& node, int& bestAxis, float& bestPosition) const
+    {
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float low = FLT_MAX, high = -FLT_MAX;
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                low = std::min(low, centroids[items[i]][axis]);
+                high = std::max(high, centroids[items[i]][axis]);
+            }
+            if (low == high)
+                continue;
+
+            struct Bin
+            {
+                glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+                glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+                int count = 0;
+            } bins[BINS];
+            float scale = BINS / (high - low);
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                int item = items[i];
+                int bin = std::min(BINS - 1, (int)((centroids[item][axis] - low) * scale));
+                bins[bin].count++;
+                bins[bin].boundsMin = glm::min(bins[bin].boundsMin, itemMin[item]);
+                bins[bin].boundsMax = glm::max(bins[bin].boundsMax, itemMax[item]);
+            }
+
+            // sweep from both ends to get the area and count left/right of each plane
+            float leftArea[BINS - 1], rightArea[BINS - 1];
+            int leftCount[BINS - 1], rightCount[BINS - 1];
+            glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BINS - 1; i++)
+            {
+                leftSum += bins[i].count;
+                leftCount[i] = leftSum;
+                leftMin = glm::min(leftMin, bins[i].boundsMin);
+                leftMax = glm::max(leftMax, bins[i].boundsMax);
+                leftArea[i] = leftSum > 0 ? area(leftMin, leftMax) : 0.0f;
+
+                rightSum += bins[BINS - 1 - i].count;
+                rightCount[BINS - 2 - i] = rightSum;
+                rightMin = glm::min(rightMin, bins[BINS - 1 - i].boundsMin);
+                rightMax = glm::max(rightMax, bins[BINS - 1 - i].boundsMax);
+                rightArea[BINS - 2 - i] = rightSum > 0 ? area(rightMin, rightMax) : 0.0f;
+            }
+
+            for (int i = 0; i < BINS - 1; i++)
+            {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestPosition = low + (i + 1) / scale;
+                }
+            }
+        }
+        return bestCost;
+    }
+
+    void subdivide(int index, int level)
+    {
+        BVHNode node = nodes[index];
+        depth = std::max(depth, (unsigned int)level);
+        if (node.count <= MAX_LEAF_ITEMS || level >= MAX_DEPTH)
+        {
+            makeLeaf(index);
+            return;
+        }
+
+        int axis = 0;
+        float position = 0.0f;
+        float splitCost = findSplit(node, axis, position);
+        float leafCost = node.count * area(node.boundsMin, node.boundsMax);
+        if (splitCost >= leafCost)
+        {
+            makeLeaf(index);
+            return;
+        }
+
+        // partition the node's items around the split plane
+        int i = node.first;
+        int j = node.first + node.count - 1;
+        while (i <= j)
+        {
+            if (centroids[items[i]][axis] < position)
+                i++;
+            else
+                std::swap(items[i], items[j--]);
+        }
+        int leftCount = i - node.first;
+        if (leftCount == 0 || leftCount == node.count)
+        {
+            makeLeaf(index);
+            return;
+        }
+
+        int left = (int)nodes.size();
+        nodes.push_back(BVHNode());
+        nodes.push_back(BVHNode());
+        parents.push_back(index);
+        parents.push_back(index);
+        nodes[left].first = node.first;
+        nodes[left].count = leftCount;
+        nodes[left + 1].first = i;
+        nodes[left + 1].count = node.count - leftCount;
+        nodes[index].first = left;
+        nodes[index].count = 0;
+
+        updateNodeBounds(left);
+        updateNodeBounds(left + 1);
+        subdivide(left, level + 1);
+        subdivide(left + 1, level + 1);
+    }
+
+    void makeLeaf(int index)
+    {
+        const BVHNode& node = nodes[index];
+        for (int i = node.first; i < node.first + node.count; i++)
+            itemLeaves[items[i]] = index;
+    }
+
+    // mark every object below a node, which is fully inside the frustum
+    void markVisible(int index, FrameVector<unsigned char>& visible)
+    {
+        const BVHNode& node = nodes[index];
+        if (node.count == 0)
+        {
+            markVisible(node.first, visible);
+            markVisible(node.first + 1, visible);
+            return;
+        }
+        for (int i = node.first; i < node.first + node.count; i++)
+        {
+            visible[items[i]] = 1;
+            visibleCount++;
+        }
+    }
+
+    // entry distance of a ray into a box (slab test); FLT_MAX on a miss
+    static float rayBoxDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+        glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+        glm::vec3 nearest = glm::min(t0, t1);
+        glm::vec3 farthest = glm::max(t0, t1);
+        float enter = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+        float exit = std::min(std::min(farthest.x, farthest.y), farthest.z);
+        return enter <= exit ? enter : FLT_MAX;
+    }
+};
+
+#endif /* bvh_h */
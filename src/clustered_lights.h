@@ -0,0 +1,450 @@
+//
+//  clustered_lights.h
+//  3D Object Drawing
+//
+//  Clustered forward shading for many local point and spot lights. The
+//  view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z depth
+//  slices (exponential, so near clusters stay small), and every frame each
+//  light's range sphere, narrowed to its cone for spot lights, is tested
+//  against the clusters' view-space bounds four at a time with SSE. The
+//  per-cluster light lists go to the shaders as texture buffers, so a
+//  fragment only loops over the lights that can reach its cluster.
+//
+//  Buffers, all read with texelFetch (see lighting.glsl, LOCAL_LIGHTS):
+//    localLights (RGBA32F):   3 texels per light, world space
+//                             position, range | color, cos outer cone | direction, cos inner cone
+//    clusterRanges (RG32UI):  per cluster, first entry in clusterLights and count
+//    clusterLights (R16UI):   light indices, cluster after cluster
+//  ClusterBlock holds what a shader needs to find its cluster.
+//
+
+#ifndef clustered_lights_h
+#define clustered_lights_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTER_TESTS_SSE 1
+#include <emmintrin.h>
+#else
+#define CLUSTER_TESTS_SSE 0
+#endif
+
+// binding point of the ClusterBlock uniform block, and the texture units of the buffers
+const GLuint CLUSTER_BLOCK_BINDING = 2;
+const GLint LOCAL_LIGHTS_UNIT = 0;
+const GLint CLUSTER_RANGES_UNIT = 1;
+const GLint CLUSTER_LIGHTS_UNIT = 2;
+
+// value of the LOCAL_LIGHTS define
+enum LocalLightMode
+{
+    LOCAL_LIGHTS_OFF = 0,
+    LOCAL_LIGHTS_CLUSTERED = 1,
+    LOCAL_LIGHTS_ALL = 2 // every fragment loops over every light; for comparison
+};
+
+// a point or spot light that reaches no further than range; an outer cone of 0 makes a point light
+struct LocalLight
+{
+    glm::vec3 position; // in the space of the lightToWorld matrix given to update()
+    float range;
+    glm::vec3 color;     // diffuse and specular intensity
+    glm::vec3 direction; // spot lights only
+    float innerCone = 0.0f; // half angles in degrees
+    float outerCone = 0.0f;
+};
+
+// CPU mirror of ClusterBlock in lighting.glsl, std140
+struct ClusterBlockData
+{
+    glm::mat4 viewProjection;
+    glm::vec4 depthRow;   // dot with a world position and 1: distance in front of the camera
+    glm::vec4 grid;       // tiles x, tiles y, slices, light count
+    glm::vec4 depthScale; // slice = log(depth) * x + y
+};
+
+class ClusteredLights
+{
+public:
+    static const int GRID_X = 16; // a multiple of 4, the SSE tests go along x
+    static const int GRID_Y = 12;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const unsigned int MAX_LIGHTS = 1024;
+    // the smallest GL_MAX_TEXTURE_BUFFER_SIZE GL 3.3 allows
+    static const unsigned int MAX_REFERENCES = 65536;
+
+    std::vector<LocalLight> lights;
+    bool clustered = true; // false: upload the lights only, for LOCAL_LIGHTS_ALL
+
+    // statistics
+    unsigned int updates = 0;
+    double assignMs = 0.0;                  // CPU time in update(), summed
+    unsigned long long referencesTotal = 0; // light list entries, summed over updates
+    unsigned int maxPerCluster = 0;         // most lights one cluster ever had
+    unsigned long long dropped = 0;         // entries over MAX_REFERENCES, never drawn
+
+    ClusteredLights()
+    {
+        glGenBuffers(1, &UBO);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterBlockData), NULL, GL_DYNAMIC_DRAW);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        glState.bindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_BLOCK_BINDING, UBO);
+
+        createBuffer(lightBuffer, lightTexture, GL_RGBA32F, MAX_LIGHTS * 3 * sizeof(glm::vec4), LOCAL_LIGHTS_UNIT);
+        createBuffer(rangeBuffer, rangeTexture, GL_RG32UI, CLUSTER_COUNT * 2 * sizeof(uint32_t), CLUSTER_RANGES_UNIT);
+        createBuffer(indexBuffer, indexTexture, GL_R16UI, MAX_REFERENCES * sizeof(uint16_t), CLUSTER_LIGHTS_UNIT);
+
+        ranges.resize(CLUSTER_COUNT * 2);
+        counts.resize(CLUSTER_COUNT);
+        indices.resize(MAX_REFERENCES);
+        for (std::vector<float>* bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ, &centerX, &centerY, &centerZ, &radius})
+            bounds->resize(CLUSTER_COUNT);
+    }
+
+    ~ClusteredLights()
+    {
+        release();
+    }
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // point a program's ClusterBlock and light samplers at the shared bindings; false if
+    // the program was compiled without local lights. The program must be in use
+    bool attach(const Shader& shader)
+    {
+        GLuint index = glGetUniformBlockIndex(shader.ID, "ClusterBlock");
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(shader.ID, index, CLUSTER_BLOCK_BINDING);
+        shader.setInt("localLights", LOCAL_LIGHTS_UNIT);
+        shader.setInt("clusterRanges", CLUSTER_RANGES_UNIT);
+        shader.setInt("clusterLights", CLUSTER_LIGHTS_UNIT);
+        return true;
+    }
+
+    // place the lights for this frame's view, build the cluster lists and upload them;
+    // the projection is a symmetric perspective with the given planes
+    void update(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& lightToWorld,
+                float nearPlane, float farPlane, FrameArena& scratch)
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned int lightCount = (unsigned int)std::min<size_t>(lights.size(), MAX_LIGHTS);
+
+        if (projection != boundsProjection)
+            buildClusterBounds(projection, nearPlane, farPlane);
+
+        // world space for the shaders, view space for the tests
+        packed.resize(lightCount * 3);
+        FrameVector<glm::vec4> viewLights(scratch); // center, range | direction, unused
+        viewLights.resize(lightCount * 2);
+        glm::mat3 directionToWorld(lightToWorld);
+        for (unsigned int i = 0; i < lightCount; i++)
+        {
+            const LocalLight& light = lights[i];
+            bool spot = light.outerCone > 0.0f;
+            glm::vec3 position = glm::vec3(lightToWorld * glm::vec4(light.position, 1.0f));
+            glm::vec3 direction = spot ? glm::normalize(directionToWorld * light.direction) : glm::vec3(0.0f);
+            packed[i * 3] = glm::vec4(position, light.range);
+            // point lights get cones that every direction passes: the spot factor clamps to 1
+            packed[i * 3 + 1] = glm::vec4(light.color, spot ? std::cos(glm::radians(light.outerCone)) : -2.0f);
+            packed[i * 3 + 2] = glm::vec4(direction, spot ? std::cos(glm::radians(light.innerCone)) : -1.0f);
+            viewLights[i * 2] = glm::vec4(glm::vec3(view * glm::vec4(position, 1.0f)), light.range);
+            viewLights[i * 2 + 1] = glm::vec4(glm::mat3(view) * direction, 0.0f);
+        }
+        if (packed != uploadedLights)
+        {
+            upload(lightBuffer, packed.data(), packed.size() * sizeof(glm::vec4), MAX_LIGHTS * 3 * sizeof(glm::vec4));
+            uploadedLights = packed;
+        }
+
+        ClusterBlockData block;
+        block.viewProjection = projection * view;
+        block.depthRow = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+        block.grid = glm::vec4(GRID_X, GRID_Y, GRID_Z, (float)lightCount);
+        block.depthScale = glm::vec4(depthScale, depthBias, 0.0f, 0.0f);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ClusterBlockData), &block);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        if (clustered)
+            assign(viewLights, lightCount, nearPlane, farPlane, scratch);
+
+        assignMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        updates++;
+    }
+
+    // free the buffers and textures; needs a current GL context
+    void release()
+    {
+        if (UBO != 0)
+        {
+            glState.forgetBuffer(UBO);
+            glDeleteBuffers(1, &UBO);
+            UBO = 0;
+        }
+        for (GLuint* buffer : {&lightBuffer, &rangeBuffer, &indexBuffer})
+        {
+            if (*buffer != 0)
+            {
+                glState.forgetBuffer(*buffer);
+                glDeleteBuffers(1, buffer);
+                *buffer = 0;
+            }
+        }
+        for (GLuint* texture : {&lightTexture, &rangeTexture, &indexTexture})
+        {
+            if (*texture != 0)
+            {
+                glState.forgetTexture(*texture);
+                glDeleteTextures(1, texture);
+                *texture = 0;
+            }
+        }
+    }
+
+private:
+    GLuint UBO = 0;
+    GLuint lightBuffer = 0, rangeBuffer = 0, indexBuffer = 0;
+    GLuint lightTexture = 0, rangeTexture = 0, indexTexture = 0;
+
+    std::vector<glm::vec4> packed, uploadedLights;
+    std::vector<uint32_t> ranges; // first, count per cluster
+    std::vector<uint32_t> counts;
+    std::vector<uint16_t> indices;
+
+    // view-space bounds of every cluster, structure of arrays for the SSE tests:
+    // the box, and the sphere around it for the cone test
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    std::vector<float> centerX, centerY, centerZ, radius;
+    glm::mat4 boundsProjection = glm::mat4(0.0f);
+    float depthScale = 0.0f, depthBias = 0.0f;
+
+    static int clusterIndex(int x, int y, int z)
+    {
+        return (z * GRID_Y + y) * GRID_X + x;
+    }
+
+    void createBuffer(GLuint& buffer, GLuint& texture, GLenum format, GLsizeiptr capacity, GLint unit)
+    {
+        glGenBuffers(1, &buffer);
+        glState.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+        // nothing else in the renderer uses textures, so each stays bound to its unit
+        glGenTextures(1, &texture);
+        glState.bindTexture(unit, GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glState.activeTexture(0);
+    }
+
+    // orphan the buffer and write its first size bytes
+    static void upload(GLuint buffer, const void* data, GLsizeiptr size, GLsizeiptr capacity)
+    {
+        glState.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // slice of a view depth, unclamped
+    int depthSlice(float depth) const
+    {
+        return (int)std::floor(std::log(depth) * depthScale + depthBias);
+    }
+
+    void buildClusterBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+    {
+        boundsProjection = projection;
+        depthScale = GRID_Z / std::log(farPlane / nearPlane);
+        depthBias = -std::log(nearPlane) * depthScale;
+
+        // a point at depth d on an NDC line: view x = ndc * d / projection[0][0]
+        float unprojectX = 1.0f / projection[0][0], unprojectY = 1.0f / projection[1][1];
+        for (int z = 0; z < GRID_Z; z++)
+        {
+            float nearDepth = nearPlane * std::pow(farPlane / nearPlane, (float)z / GRID_Z);
+            float farDepth = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / GRID_Z);
+            for (int y = 0; y < GRID_Y; y++)
+            {
+                float y0 = (-1.0f + 2.0f * y / GRID_Y) * unprojectY, y1 = (-1.0f + 2.0f * (y + 1) / GRID_Y) * unprojectY;
+                for (int x = 0; x < GRID_X; x++)
+                {
+                    float x0 = (-1.0f + 2.0f * x / GRID_X) * unprojectX, x1 = (-1.0f + 2.0f * (x + 1) / GRID_X) * unprojectX;
+                    int i = clusterIndex(x, y, z);
+                    minX[i] = std::min(x0 * nearDepth, x0 * farDepth);
+                    maxX[i] = std::max(x1 * nearDepth, x1 * farDepth);
+                    minY[i] = std::min(y0 * nearDepth, y0 * farDepth);
+                    maxY[i] = std::max(y1 * nearDepth, y1 * farDepth);
+                    minZ[i] = -farDepth; // the camera looks down -z
+                    maxZ[i] = -nearDepth;
+                    centerX[i] = 0.5f * (minX[i] + maxX[i]);
+                    centerY[i] = 0.5f * (minY[i] + maxY[i]);
+                    centerZ[i] = 0.5f * (minZ[i] + maxZ[i]);
+                    radius[i] = 0.5f * glm::length(glm::vec3(maxX[i] - minX[i], maxY[i] - minY[i], maxZ[i] - minZ[i]));
+                }
+            }
+        }
+    }
+
+    // bit k set if the sphere touches the box of cluster first + k
+    unsigned int sphereTest4(int first, const glm::vec3& center, float sphereRadius) const
+    {
+#if CLUSTER_TESTS_SSE
+        __m128 zero = _mm_setzero_ps();
+        __m128 distanceSq = zero;
+        const float* mins[3] = {&minX[first], &minY[first], &minZ[first]};
+        const float* maxs[3] = {&maxX[first], &maxY[first], &maxZ[first]};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128 c = _mm_set1_ps(center[axis]);
+            // distance from the center to the box along this axis, 0 inside
+            __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(mins[axis]), c), _mm_sub_ps(c, _mm_loadu_ps(maxs[axis]))), zero);
+            distanceSq = _mm_add_ps(distanceSq, _mm_mul_ps(d, d));
+        }
+        return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(distanceSq, _mm_set1_ps(sphereRadius * sphereRadius)));
+#else
+        unsigned int mask = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            int i = first + k;
+            float dx = std::max(std::max(minX[i] - center.x, center.x - maxX[i]), 0.0f);
+            float dy = std::max(std::max(minY[i] - center.y, center.y - maxY[i]), 0.0f);
+            float dz = std::max(std::max(minZ[i] - center.z, center.z - maxZ[i]), 0.0f);
+            if (dx * dx + dy * dy + dz * dz <= sphereRadius * sphereRadius)
+                mask |= 1u << k;
+        }
+        return mask;
+#endif
+    }
+
+    // bit k set if the cone (apex, unit axis, half angle, length) may touch the sphere
+    // around cluster first + k: the sphere's distance from the cone's surface
+    unsigned int coneTest4(int first, const glm::vec3& apex, const glm::vec3& axis, float cosAngle, float sinAngle, float length) const
+    {
+#if CLUSTER_TESTS_SSE
+        __m128 vx = _mm_sub_ps(_mm_loadu_ps(&centerX[first]), _mm_set1_ps(apex.x));
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(&centerY[first]), _mm_set1_ps(apex.y));
+        __m128 vz = _mm_sub_ps(_mm_loadu_ps(&centerZ[first]), _mm_set1_ps(apex.z));
+        __m128 r = _mm_loadu_ps(&radius[first]);
+        __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(axis.x)), _mm_mul_ps(vy, _mm_set1_ps(axis.y))),
+                                  _mm_mul_ps(vz, _mm_set1_ps(axis.z)));
+        __m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), _mm_setzero_ps()));
+        __m128 closest = _mm_sub_ps(_mm_mul_ps(across, _mm_set1_ps(cosAngle)), _mm_mul_ps(along, _mm_set1_ps(sinAngle)));
+        __m128 inside = _mm_and_ps(_mm_cmple_ps(closest, r),
+                                   _mm_and_ps(_mm_cmple_ps(along, _mm_add_ps(r, _mm_set1_ps(length))),
+                                              _mm_cmpge_ps(along, _mm_sub_ps(_mm_setzero_ps(), r))));
+        return (unsigned int)_mm_movemask_ps(inside);
+#else
+        unsigned int mask = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            int i = first + k;
+            glm::vec3 v(centerX[i] - apex.x, centerY[i] - apex.y, centerZ[i] - apex.z);
+            float along = glm::dot(v, axis);
+            float across = std::sqrt(std::max(glm::dot(v, v) - along * along, 0.0f));
+            float closest = across * cosAngle - along * sinAngle;
+            if (closest <= radius[i] && along <= radius[i] + length && along >= -radius[i])
+                mask |= 1u << k;
+        }
+        return mask;
+#endif
+    }
+
+    // test every light against the clusters its depth range spans, then sort the
+    // (cluster, light) pairs by cluster into the index list
+    void assign(const FrameVector<glm::vec4>& viewLights, unsigned int lightCount, float nearPlane, float farPlane, FrameArena& scratch)
+    {
+        FrameVector<uint32_t> pairs(scratch); // cluster << 16 | light, light after light
+        pairs.reserve(4096);
+        std::fill(counts.begin(), counts.end(), 0u);
+        for (unsigned int light = 0; light < lightCount; light++)
+        {
+            glm::vec3 center(viewLights[light * 2]);
+            float range = viewLights[light * 2].w;
+            float depth = -center.z;
+            if (depth + range < nearPlane || depth - range > farPlane)
+                continue;
+            int firstSlice = std::max(depthSlice(std::max(depth - range, nearPlane)), 0);
+            int lastSlice = std::min(depthSlice(std::min(depth + range, farPlane)), GRID_Z - 1);
+
+            const LocalLight& source = lights[light];
+            bool spot = source.outerCone > 0.0f;
+            glm::vec3 axis(viewLights[light * 2 + 1]);
+            float cosAngle = std::cos(glm::radians(source.outerCone)), sinAngle = std::sin(glm::radians(source.outerCone));
+
+            for (int z = firstSlice; z <= lastSlice; z++)
+            {
+                for (int y = 0; y < GRID_Y; y++)
+                {
+                    for (int x = 0; x < GRID_X; x += 4)
+                    {
+                        int first = clusterIndex(x, y, z);
+                        unsigned int mask = sphereTest4(first, center, range);
+                        if (mask != 0 && spot)
+                            mask &= coneTest4(first, center, axis, cosAngle, sinAngle, range);
+                        for (; mask != 0; mask &= mask - 1)
+                        {
+                            int cluster = first + ctz(mask);
+                            counts[cluster]++;
+                            pairs.push_back((uint32_t)cluster << 16 | light);
+                        }
+                    }
+                }
+            }
+        }
+
+        // counting sort; pairs are in light order, so each cluster's lights stay in order
+        uint32_t offset = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            ranges[cluster * 2] = offset;
+            ranges[cluster * 2 + 1] = 0;
+            maxPerCluster = std::max(maxPerCluster, counts[cluster]);
+            offset += counts[cluster];
+        }
+        uint32_t written = 0;
+        for (uint32_t pair : pairs)
+        {
+            uint32_t cluster = pair >> 16;
+            uint32_t slot = ranges[cluster * 2] + ranges[cluster * 2 + 1];
+            if (slot >= MAX_REFERENCES)
+            {
+                dropped++;
+                continue;
+            }
+            indices[slot] = (uint16_t)(pair & 0xFFFF);
+            ranges[cluster * 2 + 1]++;
+            written++;
+        }
+        referencesTotal += written;
+
+        upload(rangeBuffer, ranges.data(), ranges.size() * sizeof(uint32_t), CLUSTER_COUNT * 2 * sizeof(uint32_t));
+        upload(indexBuffer, indices.data(), std::min(offset, (uint32_t)MAX_REFERENCES) * sizeof(uint16_t), MAX_REFERENCES * sizeof(uint16_t));
+    }
+
+    // index of the lowest set bit of a non-zero 4-bit mask
+    static int ctz(unsigned int mask)
+    {
+        return (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+    }
+};
+
+#endif /* clustered_lights_h */
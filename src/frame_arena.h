@@ -0,0 +1,150 @@
+//
+//  frame_arena.h
+//  3D Object Drawing
+//
+//  Bump allocator for data that only lives for one frame: draw lists,
+//  visibility flags, scratch vertices. Allocation is a pointer increment,
+//  freeing is a no-op, and reset() at the start of the next frame takes
+//  everything back at once. A frame that runs past the block gets the rest
+//  from the heap, and the block is regrown to the high-water mark on the
+//  next reset(), so a steady-state frame never touches the heap.
+//
+//  FrameAllocator plugs the arena into standard containers; FrameVector is
+//  the usual form. A default-constructed FrameAllocator uses the heap.
+//
+
+#ifndef frame_arena_h
+#define frame_arena_h
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+
+class FrameArena
+{
+public:
+    // statistics
+    size_t used = 0;            // bytes of the block handed out since reset(), padding included
+    size_t highWater = 0;       // most bytes a single frame used
+    unsigned int overflows = 0; // allocations that didn't fit and went to the heap
+    unsigned int grows = 0;     // times the block was regrown after an overflow
+
+    explicit FrameArena(size_t capacity)
+    {
+        block.resize(capacity);
+        overflowBlocks.reserve(64);
+    }
+
+    ~FrameArena()
+    {
+        freeOverflow();
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    size_t capacity() const
+    {
+        return block.size();
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        uintptr_t base = (uintptr_t)block.data();
+        uintptr_t address = (base + used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        size_t end = address - base + size;
+        if (end <= block.size())
+        {
+            used = end;
+            highWater = std::max(highWater, used + overflowBytes);
+            return (void*)address;
+        }
+
+        // counted towards the high-water mark so the next reset() makes room for it
+        void* memory = ::operator new(size);
+        overflowBlocks.push_back(memory);
+        overflows++;
+        overflowBytes += size + alignment;
+        highWater = std::max(highWater, used + overflowBytes);
+        return memory;
+    }
+
+    // take back everything handed out since the last reset; containers using
+    // the arena must not be touched afterwards
+    void reset()
+    {
+        if (!overflowBlocks.empty())
+        {
+            freeOverflow();
+            block.assign(highWater + highWater / 2, 0);
+            grows++;
+        }
+        used = 0;
+        overflowBytes = 0;
+    }
+
+private:
+    std::vector<char> block;
+    std::vector<void*> overflowBlocks;
+    size_t overflowBytes = 0;
+
+    void freeOverflow()
+    {
+        for (void* memory : overflowBlocks)
+            ::operator delete(memory);
+        overflowBlocks.clear();
+    }
+};
+
+template <typename T>
+struct FrameAllocator
+{
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    FrameArena* arena = NULL; // NULL: plain heap allocation
+
+    FrameAllocator() = default;
+    FrameAllocator(FrameArena& arena) : arena(&arena)
+    {
+    }
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        if (arena == NULL)
+            return (T*)::operator new(count * sizeof(T));
+        return (T*)arena->allocate(count * sizeof(T), alignof(T));
+    }
+
+    // arena memory comes back with the next reset()
+    void deallocate(T* memory, size_t)
+    {
+        if (arena == NULL)
+            ::operator delete(memory);
+    }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif /* frame_arena_h */
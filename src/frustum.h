@@ -0,0 +1,157 @@
+//
+//  frustum.h
+//  3D Object Drawing
+//
+//  View-frustum planes extracted from a projection * view matrix, and
+//  conservative visibility tests for Bounds. The batch test classifies a list
+//  of objects four per SSE pass when glm intrinsics are enabled
+//  (GLM_FORCE_INTRINSICS); the BVH hands it the objects of the leaves that
+//  straddle the frustum.
+//
+
+#ifndef frustum_h
+#define frustum_h
+
+#include <glm/glm.hpp>
+#include <glm/simd/geometric.h>
+
+#include "bounds.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <algorithm>
+
+class Frustum
+{
+public:
+    // left, right, bottom, top, near, far; xyz points inside, normalized
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann plane extraction; viewProjection = projection * view
+    void extract(const glm::mat4& viewProjection)
+    {
+        glm::mat4 rows = glm::transpose(viewProjection);
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    // single object; false only if the box or the sphere is fully outside one plane
+    bool intersects(const Bounds& bounds) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = planeDistance(plane, bounds.center);
+            float boxRadius = glm::dot(glm::abs(glm::vec3(plane)), bounds.extent);
+            if (distance < -std::min(boxRadius, bounds.radius))
+                return false;
+        }
+        return true;
+    }
+
+    // -1 outside, 0 intersecting, 1 inside for an AABB; planes the box is fully
+    // inside are cleared from planeMask, so children of the box can skip them
+    int classify(const glm::vec3& center, const glm::vec3& extent, unsigned int& planeMask) const
+    {
+        for (int p = 0; p < 6; p++)
+        {
+            if (!(planeMask & (1u << p)))
+                continue;
+            float distance = planeDistance(planes[p], center);
+            float radius = glm::dot(glm::abs(glm::vec3(planes[p])), extent);
+            if (distance < -radius)
+                return -1;
+            if (distance >= radius)
+                planeMask &= ~(1u << p);
+        }
+        return planeMask == 0 ? 1 : 0;
+    }
+
+    // visible[items[i]] = 1 for each of the count listed objects that may be
+    // visible; the objects are tested four at a time. Returns how many were marked.
+    unsigned int cull(const BoundsSoA& bounds, const int* items, size_t count, FrameVector<unsigned char>& visible) const
+    {
+        unsigned int marked = 0;
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        glm_vec4 planeX[6], planeY[6], planeZ[6], planeW[6];
+        glm_vec4 absX[6], absY[6], absZ[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+            absX[p] = glm_vec4_abs(planeX[p]);
+            absY[p] = glm_vec4_abs(planeY[p]);
+            absZ[p] = glm_vec4_abs(planeZ[p]);
+        }
+
+        const glm_vec4 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4)
+        {
+            // a short last group repeats its final object in the spare lanes
+            int a = items[i];
+            int b = items[std::min(i + 1, count - 1)];
+            int c = items[std::min(i + 2, count - 1)];
+            int d = items[std::min(i + 3, count - 1)];
+            glm_vec4 centerX = _mm_setr_ps(bounds.centerX[a], bounds.centerX[b], bounds.centerX[c], bounds.centerX[d]);
+            glm_vec4 centerY = _mm_setr_ps(bounds.centerY[a], bounds.centerY[b], bounds.centerY[c], bounds.centerY[d]);
+            glm_vec4 centerZ = _mm_setr_ps(bounds.centerZ[a], bounds.centerZ[b], bounds.centerZ[c], bounds.centerZ[d]);
+            glm_vec4 extentX = _mm_setr_ps(bounds.extentX[a], bounds.extentX[b], bounds.extentX[c], bounds.extentX[d]);
+            glm_vec4 extentY = _mm_setr_ps(bounds.extentY[a], bounds.extentY[b], bounds.extentY[c], bounds.extentY[d]);
+            glm_vec4 extentZ = _mm_setr_ps(bounds.extentZ[a], bounds.extentZ[b], bounds.extentZ[c], bounds.extentZ[d]);
+            glm_vec4 radius = _mm_setr_ps(bounds.radius[a], bounds.radius[b], bounds.radius[c], bounds.radius[d]);
+
+            // lanes that are fully outside any plane
+            glm_vec4 outside = zero;
+            for (int p = 0; p < 6; p++)
+            {
+                // signed distance of the four centers, and the box's projected radius
+                glm_vec4 distance = glm_vec4_fma(planeX[p], centerX, glm_vec4_fma(planeY[p], centerY, glm_vec4_fma(planeZ[p], centerZ, planeW[p])));
+                glm_vec4 boxRadius = glm_vec4_fma(absX[p], extentX, glm_vec4_fma(absY[p], extentY, glm_vec4_mul(absZ[p], extentZ)));
+                glm_vec4 reach = _mm_min_ps(boxRadius, radius);
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(glm_vec4_add(distance, reach), zero));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (size_t lane = 0; lane < 4 && i + lane < count; lane++)
+            {
+                if (!(mask >> lane & 1))
+                {
+                    visible[items[i + lane]] = 1;
+                    marked++;
+                }
+            }
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            if (intersects(bounds.get(items[i])))
+            {
+                visible[items[i]] = 1;
+                marked++;
+            }
+        }
+#endif
+        return marked;
+    }
+
+private:
+    static float planeDistance(const glm::vec4& plane, const glm::vec3& point)
+    {
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        glm_vec4 result = glm_vec4_dot(_mm_setr_ps(plane.x, plane.y, plane.z, plane.w), _mm_setr_ps(point.x, point.y, point.z, 1.0f));
+        return _mm_cvtss_f32(result);
+#else
+        return glm::dot(plane, glm::vec4(point, 1.0f));
+#endif
+    }
+};
+
+#endif /* frustum_h */
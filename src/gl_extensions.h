@@ -0,0 +1,119 @@
+//
+//  gl_extensions.h
+//  3D Object Drawing
+//
+//  glad is generated for plain GL 3.3 core. The few newer entry points the
+//  renderer can take advantage of are loaded here, through the same loader
+//  function, and are only used when the driver reports them.
+//
+
+#ifndef gl_extensions_h
+#define gl_extensions_h
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// ARB_buffer_storage (core in 4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// ARB_multi_draw_indirect (core in 4.3) with ARB_base_instance (core in 4.2) for per-command instance data
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+// ARB_get_program_binary (core in 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+// KHR_parallel_shader_compile (or the ARB version with the same tokens)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+struct GLExtensions
+{
+    bool bufferStorage = false;
+    bool multiDrawIndirect = false;
+    bool programBinary = false; // also needs at least one binary format
+    bool parallelShaderCompile = false;
+
+    PFNGLBUFFERSTORAGEPROC BufferStorage = NULL;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect = NULL;
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinary = NULL;
+    PFNGLPROGRAMBINARYPROC ProgramBinary = NULL;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteri = NULL;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreads = NULL;
+};
+
+// filled in by loadGLExtensions() right after gladLoadGLLoader()
+inline GLExtensions glExtensions;
+
+// true if the current context lists the extension
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// true if the context version is at least major.minor
+inline bool hasGLVersion(int major, int minor)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+inline void loadGLExtensions(GLADloadproc load)
+{
+    if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    {
+        glExtensions.BufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+        glExtensions.bufferStorage = glExtensions.BufferStorage != NULL;
+    }
+    if (hasGLVersion(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")))
+    {
+        glExtensions.MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        glExtensions.multiDrawIndirect = glExtensions.MultiDrawElementsIndirect != NULL;
+    }
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        glExtensions.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glExtensions.ProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glExtensions.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        glExtensions.programBinary = formats > 0 && glExtensions.GetProgramBinary != NULL &&
+                                     glExtensions.ProgramBinary != NULL && glExtensions.ProgramParameteri != NULL;
+    }
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        glExtensions.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        glExtensions.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    glExtensions.parallelShaderCompile = glExtensions.MaxShaderCompilerThreads != NULL;
+}
+
+#endif /* gl_extensions_h */
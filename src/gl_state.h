@@ -0,0 +1,358 @@
+//
+//  gl_state.h
+//  3D Object Drawing
+//
+//  Thin state-tracking layer over the glad-loaded binding and fixed-function
+//  state calls. Each setter compares against the last value it set and only
+//  calls into the driver on a change; issued and skipped calls are counted
+//  per category so the savings can be measured. Code that changes tracked
+//  state behind the cache's back must call invalidate().
+//
+
+#ifndef gl_state_h
+#define gl_state_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+
+#include <iostream>
+
+enum GLStateCategory
+{
+    STATE_PROGRAM,
+    STATE_VERTEX_ARRAY,
+    STATE_BUFFER,
+    STATE_CAPABILITY,
+    STATE_DEPTH_BLEND,
+    STATE_TEXTURE,
+    STATE_CATEGORY_COUNT
+};
+
+class GLStateCache
+{
+public:
+    static const int MAX_UNIFORM_BINDINGS = 16;
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    // statistics; per category since startup, totals since beginFrame()
+    unsigned long long issued[STATE_CATEGORY_COUNT] = {};
+    unsigned long long skipped[STATE_CATEGORY_COUNT] = {};
+    unsigned int frameIssued = 0;
+    unsigned int frameSkipped = 0;
+
+    GLStateCache()
+    {
+        invalidate();
+    }
+
+    void beginFrame()
+    {
+        frameIssued = 0;
+        frameSkipped = 0;
+    }
+
+    // forget everything; the next call of every setter goes to the driver
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        for (GLuint& buffer : buffers)
+            buffer = UNKNOWN;
+        for (IndexedBinding& binding : uniformBindings)
+            binding.buffer = UNKNOWN;
+        for (int& capability : capabilities)
+            capability = -1;
+        depthFunction = UNKNOWN;
+        depthWrite = UNKNOWN;
+        blendSource = blendDestination = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (auto& unit : textures)
+            for (GLuint& texture : unit)
+                texture = UNKNOWN;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (changed(STATE_PROGRAM, program, id))
+            glUseProgram(id);
+    }
+
+    // the element array binding belongs to the VAO, so it is unknown after a switch
+    void bindVertexArray(GLuint id)
+    {
+        if (changed(STATE_VERTEX_ARRAY, vertexArray, id))
+        {
+            glBindVertexArray(id);
+            buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+    }
+
+    void bindBuffer(GLenum target, GLuint id)
+    {
+        int slot = bufferSlot(target);
+        if (slot < 0)
+        {
+            count(STATE_BUFFER, true);
+            glBindBuffer(target, id);
+        }
+        else if (changed(STATE_BUFFER, buffers[slot], id))
+        {
+            glBindBuffer(target, id);
+        }
+    }
+
+    void bindBufferBase(GLenum target, GLuint index, GLuint id)
+    {
+        bindIndexed(target, index, id, 0, -1);
+    }
+
+    void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        bindIndexed(target, index, id, offset, size);
+    }
+
+    // capabilities tracked: depth test, blend, face culling, scissor and stencil test
+    void enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+
+    void disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (changed(STATE_DEPTH_BLEND, depthFunction, function))
+            glDepthFunc(function);
+    }
+
+    void depthMask(GLboolean write)
+    {
+        if (changed(STATE_DEPTH_BLEND, depthWrite, write ? 1 : 0))
+            glDepthMask(write);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        bool same = blendSource == source && blendDestination == destination;
+        count(STATE_DEPTH_BLEND, !same);
+        if (same)
+            return;
+        blendSource = source;
+        blendDestination = destination;
+        glBlendFunc(source, destination);
+    }
+
+    // unit is zero based, not GL_TEXTURE0 + unit
+    void activeTexture(GLuint unit)
+    {
+        if (changed(STATE_TEXTURE, activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // bind a texture to a unit, switching the active unit only when needed
+    void bindTexture(GLuint unit, GLenum target, GLuint id)
+    {
+        int slot = textureSlot(target);
+        if (slot < 0 || unit >= (GLuint)MAX_TEXTURE_UNITS)
+        {
+            activeTexture(unit);
+            count(STATE_TEXTURE, true);
+            glBindTexture(target, id);
+            return;
+        }
+        if (textures[unit][slot] == id)
+        {
+            count(STATE_TEXTURE, false);
+            return;
+        }
+        activeTexture(unit);
+        changed(STATE_TEXTURE, textures[unit][slot], id);
+        glBindTexture(target, id);
+    }
+
+    // call before or after deleting an object, so a reused name is never mistaken for it
+    void forgetProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+    }
+
+    void forgetVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+    }
+
+    void forgetBuffer(GLuint id)
+    {
+        for (GLuint& buffer : buffers)
+            if (buffer == id)
+                buffer = UNKNOWN;
+        for (IndexedBinding& binding : uniformBindings)
+            if (binding.buffer == id)
+                binding.buffer = UNKNOWN;
+    }
+
+    void forgetTexture(GLuint id)
+    {
+        for (auto& unit : textures)
+            for (GLuint& texture : unit)
+                if (texture == id)
+                    texture = UNKNOWN;
+    }
+
+    void printCounts(unsigned int frames) const
+    {
+        static const char* names[STATE_CATEGORY_COUNT] = {"program", "vertex array", "buffer", "capability", "depth/blend", "texture"};
+        std::cout << "GL state: issued / skipped calls per frame";
+        const char* separator = ": ";
+        for (int category = 0; category < STATE_CATEGORY_COUNT; category++)
+        {
+            if (issued[category] + skipped[category] == 0)
+                continue;
+            std::cout << separator << names[category] << " " << (double)issued[category] / frames << " / " << (double)skipped[category] / frames;
+            separator = ", ";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    static const int BUFFER_TARGETS = 9;
+    static const int TEXTURE_TARGETS = 5;
+    static const int CAPABILITIES = 5;
+
+    struct IndexedBinding
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size; // -1 for a whole-buffer glBindBufferBase
+    };
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffers[BUFFER_TARGETS];
+    IndexedBinding uniformBindings[MAX_UNIFORM_BINDINGS];
+    int capabilities[CAPABILITIES]; // -1 unknown, 0 disabled, 1 enabled
+    GLuint depthFunction;
+    GLuint depthWrite;
+    GLenum blendSource, blendDestination;
+    GLuint activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+
+    void count(int category, bool issue)
+    {
+        if (issue)
+        {
+            issued[category]++;
+            frameIssued++;
+        }
+        else
+        {
+            skipped[category]++;
+            frameSkipped++;
+        }
+    }
+
+    // true, and the cache updated, if value differs from the cached one
+    bool changed(int category, GLuint& cached, GLuint value)
+    {
+        bool differs = cached != value;
+        count(category, differs);
+        cached = value;
+        return differs;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_COPY_READ_BUFFER: return 3;
+        case GL_COPY_WRITE_BUFFER: return 4;
+        case GL_PIXEL_PACK_BUFFER: return 5;
+        case GL_PIXEL_UNPACK_BUFFER: return 6;
+        case GL_TEXTURE_BUFFER: return 7;
+        case GL_DRAW_INDIRECT_BUFFER: return 8;
+        default: return -1;
+        }
+    }
+
+    static int textureSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_3D: return 1;
+        case GL_TEXTURE_CUBE_MAP: return 2;
+        case GL_TEXTURE_2D_ARRAY: return 3;
+        case GL_TEXTURE_BUFFER: return 4;
+        default: return -1;
+        }
+    }
+
+    static int capabilitySlot(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST: return 0;
+        case GL_BLEND: return 1;
+        case GL_CULL_FACE: return 2;
+        case GL_SCISSOR_TEST: return 3;
+        case GL_STENCIL_TEST: return 4;
+        default: return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, bool on)
+    {
+        int slot = capabilitySlot(capability);
+        bool issue = slot < 0 || capabilities[slot] != (on ? 1 : 0);
+        count(STATE_CAPABILITY, issue);
+        if (!issue)
+            return;
+        if (slot >= 0)
+            capabilities[slot] = on ? 1 : 0;
+        if (on)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    // indexed uniform buffer bindings are tracked; binding one also sets the generic binding
+    void bindIndexed(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        if (target == GL_UNIFORM_BUFFER && index < (GLuint)MAX_UNIFORM_BINDINGS)
+        {
+            IndexedBinding& binding = uniformBindings[index];
+            bool same = binding.buffer == id && binding.offset == offset && binding.size == size;
+            count(STATE_BUFFER, !same);
+            if (same)
+                return;
+            binding = {id, offset, size};
+        }
+        else
+        {
+            count(STATE_BUFFER, true);
+        }
+
+        int slot = bufferSlot(target);
+        if (slot >= 0)
+            buffers[slot] = id;
+        if (size < 0)
+            glBindBufferBase(target, index, id);
+        else
+            glBindBufferRange(target, index, id, offset, size);
+    }
+};
+
+// the context's cache; every tracked call in the renderer goes through it
+inline GLStateCache glState;
+
+#endif /* gl_state_h */
@@ -0,0 +1,241 @@
+//
+//  headless.h
+//  3D Object Drawing
+//
+//  Offscreen rendering without a window: a GL 3.3 core context created
+//  through EGL on Mesa's surfaceless platform (llvmpipe works), and a
+//  framebuffer object the frame is rendered into instead of a swap chain.
+//
+//  The EGL part is only compiled with -DHEADLESS_EGL (link with -lEGL);
+//  OffscreenTarget is plain GL and always available.
+//
+
+#ifndef headless_h
+#define headless_h
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+class HeadlessContext
+{
+public:
+    ~HeadlessContext()
+    {
+        release();
+    }
+
+    // create and make current a core-profile context with no surface
+    bool create(int major, int minor)
+    {
+        // prefer the surfaceless platform so no X/Wayland display is needed
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != NULL)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint eglMajor, eglMinor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+        {
+            std::cout << "ERROR::HEADLESS: eglInitialize failed (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+        initialized = true;
+
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS: desktop OpenGL is not supported by this EGL" << std::endl;
+            return false;
+        }
+
+        // no surface is ever created, so any GL-renderable config will do
+        EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint configCount = 0;
+        eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+        if (configCount == 0)
+            config = (EGLConfig)0;
+
+        contextMajor = major;
+        contextMinor = minor;
+        context = createContext(EGL_NO_CONTEXT);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS: eglCreateContext failed (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS: eglMakeCurrent failed (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // a second context sharing the first one's objects, for a worker thread;
+    // call after create(), on the main thread
+    bool createWorker()
+    {
+        workerContext = createContext(context);
+        if (workerContext == EGL_NO_CONTEXT)
+        {
+            std::cout << "WARNING::HEADLESS: can't create a shared context (0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // make the worker context current on the calling thread, or release it again
+    bool bindWorker()
+    {
+        return eglBindAPI(EGL_OPENGL_API) && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, workerContext);
+    }
+    void unbindWorker()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglReleaseThread();
+    }
+
+    // loader for gladLoadGLLoader() / loadGLExtensions()
+    static void* getProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+    void release()
+    {
+        if (workerContext != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(display, workerContext);
+            workerContext = EGL_NO_CONTEXT;
+        }
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        if (initialized)
+        {
+            eglTerminate(display);
+            initialized = false;
+        }
+    }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLConfig config = NULL;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLContext workerContext = EGL_NO_CONTEXT;
+    int contextMajor = 3, contextMinor = 3;
+    bool initialized = false;
+
+    EGLContext createContext(EGLContext share)
+    {
+        EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, contextMajor,
+            EGL_CONTEXT_MINOR_VERSION, contextMinor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE};
+        return eglCreateContext(display, config, share, contextAttributes);
+    }
+};
+#endif /* HEADLESS_EGL */
+
+// color + depth framebuffer object standing in for the window's back buffer
+class OffscreenTarget
+{
+public:
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    ~OffscreenTarget()
+    {
+        release();
+    }
+
+    bool create(unsigned int targetWidth, unsigned int targetHeight)
+    {
+        width = targetWidth;
+        height = targetHeight;
+
+        glGenFramebuffers(1, &FBO);
+        glGenRenderbuffers(1, &colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::OFFSCREEN_TARGET: framebuffer incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    // make the target the draw and read framebuffer
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    }
+
+    // write the color buffer as a binary PPM, top row first
+    bool savePPM(const char* path) const
+    {
+        std::vector<unsigned char> pixels(width * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::OFFSCREEN_TARGET: cannot write " << path << std::endl;
+            return false;
+        }
+        file << "P6\n" << width << " " << height << "\n255\n";
+        // GL rows start at the bottom
+        for (unsigned int row = height; row-- > 0;)
+            file.write((const char*)&pixels[row * width * 3], width * 3);
+        return true;
+    }
+
+    // free the framebuffer; needs a current GL context
+    void release()
+    {
+        if (FBO != 0)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(1, &colorRBO);
+            glDeleteRenderbuffers(1, &depthRBO);
+            FBO = colorRBO = depthRBO = 0;
+        }
+    }
+
+private:
+    unsigned int FBO = 0;
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+};
+
+#endif /* headless_h */
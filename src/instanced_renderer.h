@@ -0,0 +1,153 @@
+//
+//  instanced_renderer.h
+//  3D Object Drawing
+//
+//  Per-instance model matrix, normal matrix + color stream on the mesh arena's VAO. The
+//  instances of every mesh are collected back to back and uploaded once per
+//  frame; each draw command addresses its run through a base instance.
+//  The stream is a StreamBuffer: fenced frame regions of the persistently
+//  mapped stream arena, or else a buffer of its own orphaned every frame.
+//
+
+#ifndef instanced_renderer_h
+#define instanced_renderer_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "buffer_arena.h"
+#include "stream_buffer.h"
+#include "mesh_arena.h"
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+// layout matches object.vs with INSTANCED: color at location 2, model at 3..6,
+// normal matrix at 8..10 (7 is the mesh arena's texture coordinate)
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::mat3 normal; // inverse transpose of the model's upper 3x3
+};
+
+const GLuint INSTANCE_NORMAL_LOCATION = 8;
+
+class InstancedRenderer
+{
+public:
+    // statistics for the last upload
+    unsigned int instancesDrawn = 0;
+
+    // the instance attributes are added to the given VAO; shaders that
+    // don't declare locations 2..6 and 8..10 never read them
+    InstancedRenderer(GLuint VAO, BufferArena& buffer, unsigned int maxInstances)
+        : capacity(maxInstances), stream(buffer, maxInstances * sizeof(InstanceData), sizeof(InstanceData))
+    {
+        instances.reserve(capacity);
+
+        glState.bindVertexArray(VAO);
+        setBaseInstance(0);
+        for (GLuint location = 2; location <= INSTANCE_NORMAL_LOCATION + 2; location++)
+        {
+            if (location == TEXCOORD_LOCATION)
+                continue;
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        glState.bindVertexArray(0);
+    }
+
+    ~InstancedRenderer()
+    {
+        release();
+    }
+
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+    unsigned int getCapacity() const
+    {
+        return capacity;
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)instances.size();
+    }
+
+    // start collecting a new frame in the next region; keeps the reserved storage
+    void begin()
+    {
+        instances.clear();
+        stream.beginFrame();
+    }
+
+    // base instance of the frame's instance at index
+    GLuint baseInstance(unsigned int index) const
+    {
+        return stream.frameRegion() * capacity + index;
+    }
+
+    // normal is normalMatrix(model), which the caller usually has cached
+    void add(const glm::mat4& model, const glm::mat3& normal, const glm::vec4& color)
+    {
+        if (instances.size() >= capacity)
+        {
+            std::cout << "WARNING::INSTANCED_RENDERER: more than " << capacity << " instances, dropping" << std::endl;
+            return;
+        }
+        instances.push_back({ model, color, normal });
+    }
+
+    // upload the collected instances without drawing; returns how many there are
+    unsigned int upload()
+    {
+        instancesDrawn = (unsigned int)instances.size();
+        if (instances.empty())
+            return 0;
+
+        stream.write(instances.data(), instances.size() * sizeof(InstanceData));
+        return instancesDrawn;
+    }
+
+    // fence the frame's region once every draw that reads it has been submitted
+    void end()
+    {
+        stream.endFrame();
+    }
+
+    // point the instance attributes at a given base instance, for drivers without
+    // base-instance draws; the VAO must be bound
+    void setBaseInstance(GLuint first)
+    {
+        glState.bindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+        size_t base = stream.start() + first * sizeof(InstanceData);
+
+        // color attribute
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, color)));
+
+        // model matrix attribute, one vec4 column per location
+        for (int column = 0; column < 4; column++)
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+
+        // normal matrix attribute, one vec3 column per location
+        for (int column = 0; column < 3; column++)
+            glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, normal) + column * sizeof(glm::vec3)));
+    }
+
+    // free the stream's fences and storage; needs a current GL context
+    void release()
+    {
+        stream.release();
+    }
+
+private:
+    unsigned int capacity;
+    StreamBuffer stream;
+    std::vector<InstanceData> instances;
+};
+
+#endif /* instanced_renderer_h */
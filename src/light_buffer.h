@@ -0,0 +1,134 @@
+//
+//  light_buffer.h
+//  3D Object Drawing
+//
+//  The scene's light set as one std140 uniform block, shared by every
+//  lighting program through a single binding point and uploaded only when
+//  a light or switch actually changes.
+//
+
+#ifndef light_buffer_h
+#define light_buffer_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+
+#include <cstring>
+#include <iostream>
+
+// binding point of the LightBlock uniform block
+const GLuint LIGHT_BLOCK_BINDING = 0;
+
+// CPU mirrors of the LightBlock structs in the shaders; vec4 only, so the
+// C++ layout matches std140 without padding rules
+struct DirectionalLightBlock
+{
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+struct PointLightBlock
+{
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 attenuation; // constant, linear, quadratic, on
+};
+
+struct SpotLightBlock
+{
+    glm::vec4 position;
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 cutOff; // cutOff, outerCutOff, unused, on
+};
+
+#define NR_POINT_LIGHTS 2
+
+struct LightBlockData
+{
+    DirectionalLightBlock directionalLight;
+    PointLightBlock pointLights[NR_POINT_LIGHTS];
+    SpotLightBlock spotLight;
+    glm::vec4 emissiveLight; // rgb color, a = on
+    glm::vec4 lightSwitches; // x = directional on, y = ambient, z = diffuse, w = specular
+};
+
+class LightBuffer
+{
+public:
+    // statistics
+    unsigned int uploads = 0;      // glBufferSubData calls since startup
+    unsigned int frameUploads = 0; // uploads in the last update()
+
+    LightBuffer()
+    {
+        glGenBuffers(1, &UBO);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), NULL, GL_DYNAMIC_DRAW);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        // bound once; every attached program reads the same binding point
+        glState.bindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, UBO);
+    }
+
+    ~LightBuffer()
+    {
+        release();
+    }
+
+    LightBuffer(const LightBuffer&) = delete;
+    LightBuffer& operator=(const LightBuffer&) = delete;
+
+    // point a program's LightBlock at the shared binding; false if the program has none,
+    // which is normal for a variant compiled with every light off
+    bool attach(const Shader& shader)
+    {
+        GLuint index = glGetUniformBlockIndex(shader.ID, "LightBlock");
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(shader.ID, index, LIGHT_BLOCK_BINDING);
+        return true;
+    }
+
+    // upload the light set if it differs from what the GPU already has
+    void update(const LightBlockData& data)
+    {
+        frameUploads = 0;
+        if (uploaded && std::memcmp(&data, &current, sizeof(LightBlockData)) == 0)
+            return;
+
+        current = data;
+        uploaded = true;
+        glState.bindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlockData), &current);
+        glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploads++;
+        frameUploads = 1;
+    }
+
+    // free the buffer; needs a current GL context
+    void release()
+    {
+        if (UBO != 0)
+        {
+            glState.forgetBuffer(UBO);
+            glDeleteBuffers(1, &UBO);
+            UBO = 0;
+        }
+    }
+
+private:
+    unsigned int UBO = 0;
+    LightBlockData current;
+    bool uploaded = false;
+};
+
+#endif /* light_buffer_h */
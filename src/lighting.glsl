@@ -0,0 +1,168 @@
+// Light set and Phong terms shared by every shading model. The variant's
+// defines choose what is compiled in, so no light is switched on or off at
+// run time:
+//   DIRECTIONAL_LIGHT, SPOT_LIGHT: 0 or 1
+//   POINT_LIGHT_MASK: bit i set when point light i is on
+//   AMBIENT_TERM, DIFFUSE_TERM, SPECULAR_TERM: 0 or 1
+//   LOCAL_LIGHTS: 0, 1 for the clustered local lights, 2 to loop over all of them
+
+struct DirectionalLight {
+    vec4 direction;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+struct PointLight {
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation; // constant, linear, quadratic, on
+};
+
+struct SpotLight {
+    vec4 position;
+    vec4 direction;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 cutOff; // cutOff, outerCutOff, unused, on
+};
+
+#define NR_POINT_LIGHTS 2
+
+// light set shared by every lighting program, std140 layout matches light_buffer.h;
+// the on flags and lightSwitches are chosen by defines instead and not read here
+layout (std140) uniform LightBlock
+{
+    DirectionalLight directionalLight;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+    vec4 emissiveLight;   // rgb color, a = on; read by shaders that draw light sources
+    vec4 lightSwitches;   // x = directional on, y = ambient, z = diffuse, w = specular
+};
+
+const float shininess = 32.0;
+
+// ambient + diffuse + specular for one light direction, with the variant's terms
+vec3 CalcPhong(vec3 L, vec3 N, vec3 V, vec3 ambient, vec3 diffuse, vec3 specular)
+{
+    vec3 result = vec3(0.0);
+#if AMBIENT_TERM
+    result += ambient;
+#endif
+#if DIFFUSE_TERM
+    result += max(dot(N, L), 0.0) * diffuse;
+#endif
+#if SPECULAR_TERM
+    vec3 R = reflect(-L, N);
+    result += pow(max(dot(V, R), 0.0), shininess) * specular;
+#endif
+    return result;
+}
+
+vec3 CalcDirectionalLight(vec3 N, vec3 V)
+{
+    vec3 L = normalize(-directionalLight.direction.xyz);
+    return CalcPhong(L, N, V, directionalLight.ambient.rgb, directionalLight.diffuse.rgb, directionalLight.specular.rgb);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 Pos, vec3 N, vec3 V)
+{
+    vec3 L = normalize(light.position.xyz - Pos);
+    float d = length(light.position.xyz - Pos);
+    float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y * d + light.attenuation.z * d * d);
+    return attenuation * CalcPhong(L, N, V, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb);
+}
+
+vec3 CalcSpotLight(vec3 Pos, vec3 N, vec3 V)
+{
+    vec3 L = normalize(spotLight.position.xyz - Pos);
+    float theta = dot(L, normalize(-spotLight.direction.xyz));
+    float epsilon = spotLight.cutOff.x - spotLight.cutOff.y;
+    float intensity = clamp((theta - spotLight.cutOff.y) / epsilon, 0.0, 1.0);
+    vec3 phong = CalcPhong(L, N, V, spotLight.ambient.rgb, spotLight.diffuse.rgb, spotLight.specular.rgb);
+#if AMBIENT_TERM
+    // ambient stays outside the cone
+    return spotLight.ambient.rgb + intensity * (phong - spotLight.ambient.rgb);
+#else
+    return intensity * phong;
+#endif
+}
+
+#if LOCAL_LIGHTS
+// local point and spot lights, laid out as in clustered_lights.h
+uniform samplerBuffer localLights; // position, range | color, cos outer cone | direction, cos inner cone
+#if LOCAL_LIGHTS == 1
+uniform usamplerBuffer clusterRanges; // per cluster: first entry in clusterLights, count
+uniform usamplerBuffer clusterLights; // light indices, cluster after cluster
+#endif
+
+layout (std140) uniform ClusterBlock
+{
+    mat4 clusterViewProjection;
+    vec4 clusterDepthRow;   // dot with (Pos, 1): distance in front of the camera
+    vec4 clusterGrid;       // tiles x, tiles y, depth slices, light count
+    vec4 clusterDepthScale; // slice = log(depth) * x + y
+};
+
+// diffuse and specular of one local light; no ambient
+vec3 CalcLocalLight(int light, vec3 Pos, vec3 N, vec3 V)
+{
+    vec4 positionRange = texelFetch(localLights, light * 3);
+    vec4 colorCone = texelFetch(localLights, light * 3 + 1);
+    vec4 directionCone = texelFetch(localLights, light * 3 + 2);
+    vec3 toLight = positionRange.xyz - Pos;
+    float distanceSq = dot(toLight, toLight);
+    // inverse square, windowed to reach 0 at the range so the cluster lists miss nothing
+    float ratio = distanceSq / (positionRange.w * positionRange.w);
+    float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+    float attenuation = window * window / (distanceSq + 1.0);
+    vec3 L = toLight * inversesqrt(max(distanceSq, 1e-8));
+    // point lights carry cones of -2 and -1, which clamp this to 1
+    attenuation *= clamp((dot(L, -directionCone.xyz) - colorCone.w) / (directionCone.w - colorCone.w), 0.0, 1.0);
+    return attenuation * CalcPhong(L, N, V, vec3(0.0), colorCone.rgb, colorCone.rgb);
+}
+
+vec3 CalcLocalLights(vec3 Pos, vec3 N, vec3 V)
+{
+    vec3 result = vec3(0.0);
+#if LOCAL_LIGHTS == 1
+    // Pos's cluster: screen tile of its projection, depth slice of its log depth
+    vec4 clip = clusterViewProjection * vec4(Pos, 1.0);
+    vec2 tile = (clip.xy / max(clip.w, 1e-4)) * 0.5 + 0.5;
+    ivec2 xy = clamp(ivec2(tile * clusterGrid.xy), ivec2(0), ivec2(clusterGrid.xy) - 1);
+    float depth = max(dot(clusterDepthRow, vec4(Pos, 1.0)), 1e-4);
+    int z = clamp(int(floor(log(depth) * clusterDepthScale.x + clusterDepthScale.y)), 0, int(clusterGrid.z) - 1);
+    int cluster = (z * int(clusterGrid.y) + xy.y) * int(clusterGrid.x) + xy.x;
+    uvec2 range = texelFetch(clusterRanges, cluster).xy;
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcLocalLight(int(texelFetch(clusterLights, int(range.x + i)).x), Pos, N, V);
+#else
+    for (int i = 0; i < int(clusterGrid.w); i++)
+        result += CalcLocalLight(i, Pos, N, V);
+#endif
+    return result;
+}
+#endif
+
+// every light of the variant at a world-space position; N and V normalized
+vec3 CalcLighting(vec3 Pos, vec3 N, vec3 V)
+{
+    vec3 result = vec3(0.0);
+#if DIRECTIONAL_LIGHT
+    result += CalcDirectionalLight(N, V);
+#endif
+    // the mask is a constant, so the compiler keeps only the lights that are on
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+        if ((POINT_LIGHT_MASK & (1 << i)) != 0)
+            result += CalcPointLight(pointLights[i], Pos, N, V);
+#if SPOT_LIGHT
+    result += CalcSpotLight(Pos, N, V);
+#endif
+#if LOCAL_LIGHTS
+    result += CalcLocalLights(Pos, N, V);
+#endif
+    return result;
+}
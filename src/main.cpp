@@ -13,42 +13,101 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/intersect.hpp>
 
 #include "shader.h"
 #include "basic_camera.h"
+#include "mesh_cache.h"
+#include "instanced_renderer.h"
+#include "scene.h"
+#include "light_buffer.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "uniform_ring.h"
+#include "buffer_arena.h"
+#include "headless.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "render_queue.h"
+#include "multi_draw.h"
+#include "static_batch.h"
+#include "frame_arena.h"
+#include "shader_variants.h"
+#include "shader_compiler.h"
+#include "shader_watcher.h"
+#include "clustered_lights.h"
 
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <new>
 
 using namespace std;
 
+#ifdef COUNT_HEAP_ALLOCATIONS
+// every operator new in the process is counted, so a frame can check that it made no
+// heap allocations; this includes C++ inside the driver (llvmpipe's LLVM JIT), while
+// its C code calls malloc directly and isn't seen. Only the headless build enables it.
+std::atomic<unsigned long long> heapAllocations(0);
+
+void *operator new(size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    for (;;)
+    {
+        if (void *memory = malloc(size > 0 ? size : 1))
+            return memory;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == NULL)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+// GCC can't tell that operator new above is the matching malloc
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+#pragma GCC diagnostic pop
+#endif
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-void generateSphereVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, int rings, float radius);
-void drawSphere(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-                float posX, float posY, float posZ, float rotX, float rotY, float rotZ, float scX, float scY, float scZ, float radius, glm::vec4 color);
-void drawCone(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans, float posX, float posY, float posZ, float rotX, float rotY, float rotZ, float scX, float scY, float scZ, float height, float radius, glm::vec4 color);
-void generateConeVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, float height, float radius);
-
-// draw object functions
-void drawCube(Shader shaderProgram, unsigned int VAO,
-              glm::mat4 parentTrans,
-              float posX = 0.0f, float posY = 0.0f, float posZ = 0.0f,
-              float rotX = 0.0f, float rotY = 0.0f, float rotZ = 0.0f,
-              float scX = 1.0f, float scY = 1.0f, float scZ = 1.0f,
-              glm::vec4 color = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)); // Default color is green
-
-// Genearate Cylinder Vertices shadowing
-void generateCylinderVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, float height, float radius);
-
-// draw Cylinder shadow parameter
-void drawCylinder(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-                  float posX, float posY, float posZ,
-                  float rotX, float rotY, float rotZ,
-                  float scX, float scY, float scZ,
-                  float height, float radius, glm::vec4 color);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+
+// add the room's furniture to the scene; returns the root node and the fan group
+int buildRoom(Scene &scene, int &fan);
+
+// count small colored point and spot lights spread through the room, in room space
+void scatterLocalLights(std::vector<LocalLight> &lights, unsigned int count);
+
+// closest drawable under a window position, or -1; fills in the distance along the view ray
+int pickDrawable(const Scene &scene, BVH &bvh, const MeshCache &meshCache, const MeshHandle *sceneMeshes,
+                 const glm::mat4 &viewProjection, double x, double y, float &distance);
+
+// light set and toggles in the shared uniform block layout
+LightBlockData packLights();
+
+// lighting bits of the object variant key for the current light toggles
+uint32_t lightingVariant();
+
 // define callback function
 void window_close_callback(GLFWwindow *window)
 {
@@ -58,6 +117,110 @@ void window_close_callback(GLFWwindow *window)
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+// headless and benchmark runs advance time in fixed steps so they are repeatable
+const float FIXED_TIMESTEP = 1.0f / 60.0f;
+// benchmark frames rendered before the camera path starts; not part of the statistics
+const unsigned int BENCHMARK_WARMUP_FRAMES = 30;
+// frames from this one on should make no heap allocations; the first few are left to the
+// driver to compile its state variants, and profiling (which records history) is exempt
+const unsigned int STEADY_STATE_FRAME = 5;
+
+// where linked program binaries are kept between runs, relative to the working directory
+const char *const SHADER_CACHE_DIRECTORY = "shader_cache";
+// where object.vs, object.fs and their includes are read from, and watched for edits
+const char *const SHADER_DIRECTORY = ".";
+
+// bits of an object program's variant key, and the defines of object.vs and lighting.glsl they set
+const uint32_t VARIANT_INSTANCED = 1 << 0;
+const uint32_t VARIANT_GOURAUD = 1 << 1;
+const uint32_t VARIANT_NORMAL_MATRIX_FROM_MODEL = 1 << 2;
+const int VARIANT_LIGHTING_SHIFT = 3;
+const VariantDefine OBJECT_VARIANT_DEFINES[] = {
+    {"INSTANCED", 0, 1},
+    {"SHADING_GOURAUD", 1, 1},
+    {"NORMAL_MATRIX_FROM_MODEL", 2, 1},
+    {"DIRECTIONAL_LIGHT", VARIANT_LIGHTING_SHIFT, 1},
+    {"POINT_LIGHT_MASK", VARIANT_LIGHTING_SHIFT + 1, NR_POINT_LIGHTS},
+    {"SPOT_LIGHT", VARIANT_LIGHTING_SHIFT + 1 + NR_POINT_LIGHTS, 1},
+    {"AMBIENT_TERM", VARIANT_LIGHTING_SHIFT + 2 + NR_POINT_LIGHTS, 1},
+    {"DIFFUSE_TERM", VARIANT_LIGHTING_SHIFT + 3 + NR_POINT_LIGHTS, 1},
+    {"SPECULAR_TERM", VARIANT_LIGHTING_SHIFT + 4 + NR_POINT_LIGHTS, 1},
+    {"LOCAL_LIGHTS", VARIANT_LIGHTING_SHIFT + 5 + NR_POINT_LIGHTS, 2}};
+// lighting of the stand-in variant drawn while the real one compiles: directional light,
+// ambient and diffuse only; everything below the lighting fields has to match
+const uint32_t VARIANT_FALLBACK_MASK = (1u << VARIANT_LIGHTING_SHIFT) - 1;
+const uint32_t VARIANT_FALLBACK_LIGHTING = (1u | 1u << (2 + NR_POINT_LIGHTS) | 1u << (3 + NR_POINT_LIGHTS)) << VARIANT_LIGHTING_SHIFT;
+
+// handles of the per-frame uniforms of the object variant in use; resolved again
+// only when a light toggle switches to another variant
+struct ObjectUniforms
+{
+    GLuint program = 0;
+    UniformHandle view, projection, viewPos;
+
+    void set(const Shader &shader, const glm::mat4 &projectionMatrix, const glm::mat4 &viewMatrix, const glm::vec3 &position)
+    {
+        if (program != shader.ID)
+        {
+            program = shader.ID;
+            view = shader.uniform("view");
+            projection = shader.uniform("projection");
+            viewPos = shader.uniform("viewPos");
+        }
+        shader.use();
+        shader.setMat4(projection, projectionMatrix);
+        shader.setMat4(view, viewMatrix);
+        shader.setVec3(viewPos, position);
+    }
+};
+
+// binding point of the per-draw ObjectBlock uniform block
+const GLuint OBJECT_BLOCK_BINDING = 1;
+
+// CPU mirror of ObjectBlock in object.vs (std140); a mat3 takes three vec4 columns
+struct ObjectBlockData
+{
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::mat3x4 normalMatrix;
+};
+
+// parts of the room; each is drawn as its own profiler scope
+enum DrawGroup
+{
+    DRAW_GROUP_FURNITURE,
+    DRAW_GROUP_WALLS,
+    DRAW_GROUP_FAN,
+    DRAW_GROUP_LAMP,
+    DRAW_GROUP_STATIC, // the merged static room; no node is added to it directly
+    DRAW_GROUP_COUNT
+};
+const char *drawGroupNames[DRAW_GROUP_COUNT] = {"furniture", "walls", "fan", "lamp", "static room"};
+
+// program field of the render queue's sort key; the static room holds the nearby
+// furniture, and draws its own small objects before its walls
+enum RenderProgram
+{
+    RENDER_PROGRAM_STATIC,
+    RENDER_PROGRAM_INSTANCED
+};
+
+// number of mesh ids the scene uses
+const unsigned int SCENE_MESH_COUNT = PRIMITIVE_CONE + 1;
+
+// mesh field of the sort key for the static batch, after the scene's primitive ids
+const unsigned int STATIC_BATCH_MESH = SCENE_MESH_COUNT;
+
+// a visible dynamic drawable, keyed like its queue item so that sorting groups
+// the drawables by pass and mesh, front to back
+struct DynamicDraw
+{
+    uint64_t key;
+    int node;
+};
 
 // modelling transform
 float rotateAngle_X = 0.0;
@@ -75,6 +238,10 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// picking; a left click is resolved at the next frame
+bool pickRequested = false;
+double pickX = 0.0, pickY = 0.0;
+
 BasicCamera basic_camera(3.0f, 3.0f, 3.0f, 0.0f, 0.0f, 0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 
 // timing
@@ -127,6 +294,9 @@ bool emissiveLightOn = true;
 bool ambientOn = true;
 bool diffuseOn = true;
 bool specularOn = true;
+bool localLightsOn = true;
+// how the object variants read the local lights while they are on; off without --lights
+LocalLightMode localLightMode = LOCAL_LIGHTS_OFF;
 
 // Define lights
 DirectionalLight directionalLight = {
@@ -164,105 +334,394 @@ EmissiveLight emissiveLight = {
     glm::vec3(1.0f, 1.0f, 1.0f) // White light
 };
 
-int main()
+int main(int argc, char *argv[])
 {
-    // glfw: initialize and configure
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    auto programStart = chrono::steady_clock::now();
+
+    // command line (run from src/ so the shaders are found):
+    //   --headless [frames] [image.ppm]: render offscreen for a fixed number of frames, then exit
+    //   --benchmark camera_path.txt [results.json]: replay a camera path offscreen and write frame statistics
+    //   --profile [trace.json]: time passes on CPU and GPU, print a rolling breakdown and write a Chrome trace
+    //   --no-multidraw: issue the instanced draws one by one even where multi-draw indirect is available
+    //   --float-vertices: store mesh vertices as plain floats instead of the compact encoding
+    //   --no-shader-cache: always compile the shader programs instead of loading cached binaries
+    //   --gouraud: light per vertex instead of per fragment
+    //   --normal-matrix-in-shader: invert the model matrix per vertex instead of using the uploaded normal matrix
+    //   --sync-shaders: build every shader before it is drawn with, on the main thread
+    //   --shader-worker: build shaders on a worker thread even where the driver compiles in parallel
+    //   --no-shader-reload: don't watch the shader sources for edits
+    //   --lights count: add count local point and spot lights, shaded through clustered light lists
+    //   --no-clusters: shade every fragment with every local light instead, for comparison
+    bool headless = false;
+    bool multiDrawIndirect = true;
+    VertexEncoding vertexEncoding = VERTEX_COMPACT;
+    bool shaderCache = true;
+    bool asyncShaders = true;
+    bool shaderWorker = false;
+    bool shaderReload = true;
+    unsigned int localLightCount = 0;
+    bool lightClusters = true;
+    uint32_t objectVariantBase = 0; // shading model and normal-matrix source of every object program
+    bool benchmark = false;
+    unsigned int headlessFrames = 300;
+    const char *headlessImage = NULL;
+    const char *benchmarkPath = NULL;
+    const char *benchmarkResults = "benchmark.json";
+    const char *profileTrace = NULL;
+    Profiler profiler;
+    for (int i = 1; i < argc; i++)
+    {
+        // optional values are the following arguments that are not flags themselves
+        auto nextValue = [&](const char *fallback) -> const char *
+        {
+            return i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0 ? argv[++i] : fallback;
+        };
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+            const char *frames = nextValue(NULL);
+            if (frames != NULL)
+                headlessFrames = (unsigned int)atoi(frames);
+            headlessImage = nextValue(NULL);
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0)
+        {
+            benchmark = headless = true;
+            benchmarkPath = nextValue(NULL);
+            benchmarkResults = nextValue(benchmarkResults);
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profiler.enabled = true;
+            profileTrace = nextValue("profile_trace.json");
+        }
+        else if (strcmp(argv[i], "--no-multidraw") == 0)
+        {
+            multiDrawIndirect = false;
+        }
+        else if (strcmp(argv[i], "--float-vertices") == 0)
+        {
+            vertexEncoding = VERTEX_FLOAT;
+        }
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+        {
+            shaderCache = false;
+        }
+        else if (strcmp(argv[i], "--gouraud") == 0)
+        {
+            objectVariantBase |= VARIANT_GOURAUD;
+        }
+        else if (strcmp(argv[i], "--normal-matrix-in-shader") == 0)
+        {
+            objectVariantBase |= VARIANT_NORMAL_MATRIX_FROM_MODEL;
+        }
+        else if (strcmp(argv[i], "--sync-shaders") == 0)
+        {
+            asyncShaders = false;
+        }
+        else if (strcmp(argv[i], "--shader-worker") == 0)
+        {
+            shaderWorker = true;
+        }
+        else if (strcmp(argv[i], "--no-shader-reload") == 0)
+        {
+            shaderReload = false;
+        }
+        else if (strcmp(argv[i], "--lights") == 0)
+        {
+            const char *count = nextValue(NULL);
+            if (count == NULL)
+            {
+                std::cout << "--lights needs a light count" << std::endl;
+                return -1;
+            }
+            localLightCount = std::min((unsigned int)atoi(count), ClusteredLights::MAX_LIGHTS);
+        }
+        else if (strcmp(argv[i], "--no-clusters") == 0)
+        {
+            lightClusters = false;
+        }
+        else
+        {
+            std::cout << "Unknown argument " << argv[i] << std::endl;
+            return -1;
+        }
+    }
+
+    CameraPath cameraPath;
+    if (benchmark)
+    {
+        if (benchmarkPath == NULL)
+        {
+            std::cout << "--benchmark needs a camera path file" << std::endl;
+            return -1;
+        }
+        if (!cameraPath.load(benchmarkPath))
+            return -1;
+        headlessFrames = BENCHMARK_WARMUP_FRAMES + (unsigned int)ceil(cameraPath.duration() / FIXED_TIMESTEP) + 1;
+    }
+
+    GLFWwindow *window = NULL;
+    GLFWwindow *workerWindow = NULL; // hidden, only for its context shared with window
+    GLADloadproc loadProc = (GLADloadproc)glfwGetProcAddress;
+#ifdef HEADLESS_EGL
+    HeadlessContext headlessContext;
 #endif
 
-    // glfw window creation
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
-    if (window == NULL)
+    if (headless)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+#ifdef HEADLESS_EGL
+        if (!headlessContext.create(3, 3))
+            return -1;
+        loadProc = (GLADloadproc)HeadlessContext::getProcAddress;
+#else
+        std::cout << "Headless mode needs a build with -DHEADLESS_EGL" << std::endl;
         return -1;
+#endif
+    }
+    else
+    {
+        // glfw: initialize and configure
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "CSE 4208: Computer Graphics Laboratory", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetWindowCloseCallback(window, window_close_callback); // Set the window close callback function
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetWindowCloseCallback(window, window_close_callback); // Set the window close callback function
 
     // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader(loadProc))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions(loadProc);
 
-    // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
-
-    // build and compile our shader program
-    Shader ourShader("vertexShader.vs", "fragmentShader.fs");
-
-    // set up vertex data (and buffer(s)) and configure vertex attributes for cube
-    float cube_vertices[] = {
-        // positions          // colors
-        0.0f, 0.0f, 0.0f, 0.3f, 0.8f, 0.5f,
-        0.5f, 0.0f, 0.0f, 0.5f, 0.4f, 0.3f,
-        0.5f, 0.5f, 0.0f, 0.2f, 0.7f, 0.3f,
-        0.0f, 0.5f, 0.0f, 0.6f, 0.2f, 0.8f,
-        0.0f, 0.0f, 0.5f, 0.8f, 0.3f, 0.6f,
-        0.5f, 0.0f, 0.5f, 0.4f, 0.4f, 0.8f,
-        0.5f, 0.5f, 0.5f, 0.2f, 0.3f, 0.6f,
-        0.0f, 0.5f, 0.5f, 0.7f, 0.5f, 0.4f};
-    unsigned int cube_indices[] = {
-        0, 3, 2,
-        2, 1, 0,
-
-        1, 2, 6,
-        6, 5, 1,
-
-        5, 6, 7,
-        7, 4, 5,
-
-        4, 7, 3,
-        3, 0, 4,
-
-        6, 2, 3,
-        3, 7, 6,
-
-        1, 5, 4,
-        4, 0, 1};
-
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
+    // headless frames go to an FBO of the window's size
+    OffscreenTarget offscreen;
+    if (headless)
+    {
+        if (!offscreen.create(SCR_WIDTH, SCR_HEIGHT))
+            return -1;
+        // keep the fan spinning so the dynamic part of the scene is exercised
+        isFanRotating = true;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+    // configure global opengl state
+    glState.enable(GL_DEPTH_TEST);
+
+    // GPU memory comes from two large buffers: geometry (cached meshes and the static
+    // batch) and stream, for everything rewritten each frame (instances, draw commands,
+    // object blocks); the stream buffer is persistently mapped where possible
+    BufferArena geometryArena(256 * 1024, GL_STATIC_DRAW);
+    BufferArena streamArena(256 * 1024, GL_STREAM_DRAW, true);
+
+    // linked programs are cached on disk per driver, so a warm start skips compilation
+    ProgramCache programCache;
+    if (shaderCache)
+        programCache.open(SHADER_CACHE_DIRECTORY);
+
+    // shaders compile in the background: in the driver's own threads where it offers
+    // that, otherwise on a worker thread with a context sharing the main one's objects
+    ShaderCompiler shaderCompiler;
+    if (asyncShaders && (shaderWorker || !shaderCompiler.startParallel()))
+    {
+        if (headless)
+        {
+#ifdef HEADLESS_EGL
+            if (headlessContext.createWorker())
+                shaderCompiler.startWorker([&]() { return headlessContext.bindWorker(); },
+                                           [&]() { headlessContext.unbindWorker(); });
+#endif
+        }
+        else
+        {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            workerWindow = glfwCreateWindow(1, 1, "", NULL, window);
+            if (workerWindow != NULL)
+                shaderCompiler.startWorker([&]() { glfwMakeContextCurrent(workerWindow); return true; },
+                                           [&]() { glfwMakeContextCurrent(NULL); });
+        }
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+    // one light block shared by every program
+    LightBuffer lightBuffer;
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
+    // any number of short-range lights on top of the named ones; each frame they are
+    // binned into view-space clusters so a fragment only shades the lights near it;
+    // created only with --lights, since its buffers and texture units are unused otherwise
+    std::unique_ptr<ClusteredLights> clusteredLights;
+    if (localLightCount > 0)
+    {
+        clusteredLights.reset(new ClusteredLights());
+        clusteredLights->clustered = lightClusters;
+        scatterLocalLights(clusteredLights->lights, localLightCount);
+        localLightMode = lightClusters ? LOCAL_LIGHTS_CLUSTERED : LOCAL_LIGHTS_ALL;
+    }
 
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // per-draw model and color, written linearly into a ring each frame
+    UniformRing objectRing(streamArena, OBJECT_BLOCK_BINDING, sizeof(ObjectBlockData), 64);
+
+    // white object color, constant for the whole run
+    glm::vec3 objectColor(1.0f, 1.0f, 1.0f);
+
+    // every object is drawn by a variant of one shader pair: instanced for the dynamic
+    // drawables (model and color from the instance stream) or the merged static room
+    // (geometry already in room space, color per vertex), with exactly the lights that
+    // are on compiled in. Variants are built on first use and hooked up to the shared
+    // blocks once ready; until then a draw uses the last variant it had, or at first a
+    // cheaper fallback. The variants for the starting light set are started here, after
+    // the fallbacks so those are ready soonest, and compile while the scene is set up
+    ShaderVariants objectShaders("object.vs", "object.fs",
+                                 std::vector<VariantDefine>(std::begin(OBJECT_VARIANT_DEFINES), std::end(OBJECT_VARIANT_DEFINES)),
+                                 &programCache, [&](Shader &shader, uint32_t key)
+    {
+        lightBuffer.attach(shader);
+        if (!(key & VARIANT_INSTANCED))
+            objectRing.attach(shader, "ObjectBlock");
+        shader.use();
+        shader.setVec3("objectColor", objectColor);
+        if (clusteredLights)
+            clusteredLights->attach(shader);
+    });
+    objectShaders.setCompiler(&shaderCompiler, VARIANT_FALLBACK_MASK, VARIANT_FALLBACK_LIGHTING);
+    if (shaderCompiler.mode != ShaderCompiler::COMPILE_SYNCHRONOUS)
+    {
+        objectShaders.request(objectVariantBase | VARIANT_INSTANCED | VARIANT_FALLBACK_LIGHTING);
+        objectShaders.request(objectVariantBase | VARIANT_FALLBACK_LIGHTING);
+    }
+    objectShaders.request(objectVariantBase | VARIANT_INSTANCED | lightingVariant());
+    objectShaders.request(objectVariantBase | lightingVariant());
+
+    // saved edits to the shader sources rebuild the variants that read them, in the
+    // background; a rebuild that fails to compile leaves the running program in place
+    ShaderWatcher shaderWatcher;
+    if (shaderReload)
+        shaderWatcher.open(SHADER_DIRECTORY);
+    ObjectUniforms instancedUniforms, staticUniforms;
+
+    // build every procedural mesh once, into the cache's shared arena; the render
+    // loop only looks up handles
+    MeshCache meshCache(geometryArena, vertexEncoding);
+    MeshHandle cubeMesh = meshCache.getCube();
+    MeshHandle cylinderMesh = meshCache.getCylinder(36, 0.9f, 0.5f);
+    MeshHandle sphereMesh = meshCache.getSphere(36, 18, 0.2f);
+    MeshHandle coneMesh = meshCache.getCone(36, 0.8f, 0.3f);
+
+    // mesh table indexed by the scene's mesh ids
+    MeshHandle sceneMeshes[4];
+    sceneMeshes[PRIMITIVE_CUBE] = cubeMesh;
+    sceneMeshes[PRIMITIVE_CYLINDER] = cylinderMesh;
+    sceneMeshes[PRIMITIVE_SPHERE] = sphereMesh;
+    sceneMeshes[PRIMITIVE_CONE] = coneMesh;
+
+    Scene scene;
+    int fanNode;
+    int roomNode = buildRoom(scene, fanNode);
+    for (int mesh = 0; mesh < 4; mesh++)
+        scene.setMeshBounds(mesh, sceneMeshes[mesh].bounds);
+
+    // spatial index over the drawables' world bounds; the room moves rigidly and
+    // only the fan moves inside it, so refitting keeps the tree's quality
+    scene.updateTransforms();
+    BVH bvh;
+    bvh.build(scene.worldBounds);
+
+    // everything in the room except the fan, merged into one draw; rebuilt whenever
+    // the scene reports a change to its static nodes
+    StaticBatch staticBatch(geometryArena);
+
+    // drawables outside the view are skipped before any uniform or draw work
+    Frustum frustum;
+    unsigned long long visibleTotal = 0, culledTotal = 0;
+
+    // one instance stream for every dynamic drawable on the arena's VAO, and the
+    // frame's draw commands into it
+    InstancedRenderer instances(meshCache.arena.VAO, streamArena, 256);
+    MultiDrawBuffer multiDraw(instances, streamArena, 64, multiDrawIndirect);
+
+    // the frame's draws in state-sorted order; while profiling every draw group is
+    // its own pass so it can be timed, otherwise everything shares pass 0
+    RenderQueue renderQueue;
+    renderQueue.multiDraw = &multiDraw;
+
+    // every list that only lives for one frame (visibility, draw lists, the queue's
+    // items, static batch vertices) comes from here and is dropped in one reset
+    FrameArena frameArena(256 * 1024);
+    renderQueue.arena = &frameArena;
+#ifdef COUNT_HEAP_ALLOCATIONS
+    unsigned long long steadyStateAllocations = 0;
+#endif
+    unsigned long long queueItemsTotal = 0;
+    unsigned long long commandsTotal = 0, multiDrawCallsTotal = 0;
+    unsigned int frameCount = 0;
+    double firstFrameMs = 0.0;
+
+    // benchmark-only instrumentation
+    GpuFrameTimer gpuTimer;
+    BenchmarkReport benchmarkReport;
+    if (benchmark)
+    {
+        gpuTimer.frameMs.reserve(headlessFrames);
+        benchmarkReport.frames.reserve(headlessFrames);
+    }
 
     // render loop
-    while (!glfwWindowShouldClose(window))
+    while (headless ? frameCount < headlessFrames : !glfwWindowShouldClose(window))
     {
-        // per-frame time logic
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // per-frame time logic; headless runs use a fixed 60 Hz step so they are repeatable
+        if (headless)
+        {
+            deltaTime = FIXED_TIMESTEP;
+        }
+        else
+        {
+            float currentFrame = static_cast<float>(glfwGetTime());
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+        }
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+        unsigned long long allocationsBefore = heapAllocations.load(std::memory_order_relaxed);
+#endif
+        frameArena.reset();
+        meshCache.beginFrame();
+        glState.beginFrame();
 
         // input
-        processInput(window);
+        if (window != NULL)
+            processInput(window);
+
+        profiler.beginFrame();
+        int frameScope = profiler.begin("frame");
+
+        // benchmark: the camera follows the scripted path, after the warm-up frames
+        auto frameStart = chrono::steady_clock::now();
+        unsigned int uniformUploadsBefore = objectShaders.uniformUploads();
+        if (benchmark)
+        {
+            float pathTime = frameCount < BENCHMARK_WARMUP_FRAMES ? 0.0f : (frameCount - BENCHMARK_WARMUP_FRAMES) * FIXED_TIMESTEP;
+            cameraPath.apply(basic_camera, pathTime);
+            gpuTimer.begin(frameCount);
+        }
 
         // update fan rotation if it's rotating
         if (isFanRotating)
@@ -273,310 +732,309 @@ int main()
         }
 
         // render
+        int clearScope = profiler.begin("clear");
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        profiler.end(clearScope);
 
         // pass projection matrix to shader
-        glm::mat4 projection = glm::perspective(glm::radians(basic_camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
+        glm::mat4 projection = glm::perspective(glm::radians(basic_camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
 
         // camera/view transformation
         glm::mat4 view = basic_camera.createViewMatrix();
-        ourShader.setMat4("view", view);
-
-        std::vector<float> cylinderVertices;
-        std::vector<unsigned int> cylinderIndices;
-        int segments = 36;
-        float height = 0.9f;
-        float radius = 0.5f;
-
-        // Generate cylinder vertices and indices
-        generateCylinderVertices(cylinderVertices, cylinderIndices, segments, height, radius);
-
-        // Create buffers and arrays
-        unsigned int cylinderVAO, cylinderVBO, cylinderEBO;
-        glGenVertexArrays(1, &cylinderVAO);
-        glGenBuffers(1, &cylinderVBO);
-        glGenBuffers(1, &cylinderEBO);
-
-        glBindVertexArray(cylinderVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, cylinderVBO);
-        glBufferData(GL_ARRAY_BUFFER, cylinderVertices.size() * sizeof(float), &cylinderVertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cylinderEBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, cylinderIndices.size() * sizeof(unsigned int), &cylinderIndices[0], GL_STATIC_DRAW);
-
-        // position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-        glEnableVertexAttribArray(0);
-
-        // color attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        glm::mat4 parentTrans = glm::mat4(1.0f);
-
-        // Apply a translation to move the entire table
-        parentTrans = glm::translate(parentTrans, glm::vec3(translate_X, translate_Y, translate_Z));
-
-        // Apply rotation around the X-axis
-        parentTrans = glm::rotate(parentTrans, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
-
-        // Apply rotation around the Y-axis
-        parentTrans = glm::rotate(parentTrans, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
-
-        // Apply rotation around the Z-axis
-        parentTrans = glm::rotate(parentTrans, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-        // Drawing Table
-        // drawCube(ourShader, VAO, parentTrans, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 3.0f, 0.2f, 3.0f, glm::vec4(0.72f, 0.52f, 0.04f, 1.0f)); // wooden surface
-        drawCylinder(ourShader, cylinderVAO, parentTrans,
-                     0.5f, 0.5f, 0.5f,  // position
-                     0.0f, 0.0f, 0.0f,  // rotation
-                     1.9f, 0.04f, 1.9f, // scale
-                     0.8f, 0.01f,
-                     glm::vec4(0.72f, 0.52f, 0.04f, 1.0f));
-
-        // cylindrical leg
-        drawCylinder(ourShader, cylinderVAO, parentTrans,
-                     0.0f, 0.36f, 0.0f, // position
-                     0.0f, 0.0f, 0.0f,  // rotation
-                     0.3f, 0.56f, 0.3f, // scale
-                     0.5f, 0.01f,
-                     glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
-
-        // Chair 1 (Front)
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 0.25f, 0.9f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
-        drawCube(ourShader, VAO, parentTrans, -0.2f, 0.1f, 0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, 0.2f, 0.1f, 0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, -0.2f, 0.1f, 1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, 0.2f, 0.1f, 1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 0.4f, 1.13f, 0.0f, 90.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f)); // backrest
-
-        // Chair 2 (Back)
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 0.25f, -0.9f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f));  // wooden seat
-        drawCube(ourShader, VAO, parentTrans, -0.2f, 0.1f, -0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, 0.2f, 0.1f, -0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));    // leg
-        drawCube(ourShader, VAO, parentTrans, 0.2f, 0.1f, -1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));    // leg
-        drawCube(ourShader, VAO, parentTrans, -0.2f, 0.1f, -1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 0.4f, -1.13f, 0.0f, -90.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f)); // backrest
-
-        // Chair 3 (Right)
-        drawCube(ourShader, VAO, parentTrans, 0.9f, 0.25f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
-        drawCube(ourShader, VAO, parentTrans, 0.7f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, 0.7f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, 1.1f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, 1.1f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, 1.13f, 0.4f, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // backrest
-
-        // Chair 4 (Left)
-        drawCube(ourShader, VAO, parentTrans, -0.9f, 0.25f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
-        drawCube(ourShader, VAO, parentTrans, -0.7f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, -0.7f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, -1.1f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
-        drawCube(ourShader, VAO, parentTrans, -1.1f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
-        drawCube(ourShader, VAO, parentTrans, -1.13f, 0.4f, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // backrest
-
-        // Drawing floor
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 12.0, 0.05, 12.0, glm::vec4(0.7f, 0.7f, 0.7f, 1.0f));
-
-        // Drawing walls
-        drawCube(ourShader, VAO, parentTrans, -3.0, 1.5, 0.0f, 0.0f, 0.0f, 0.0f, 0.05, 6.0, 12.0, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // wall
-        drawCube(ourShader, VAO, parentTrans, 3.0, 1.5, 0.0f, 0.0f, 0.0f, 0.0f, 0.05, 6.0, 12.0, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));  // wall
-        drawCube(ourShader, VAO, parentTrans, 0.0f, 1.5, -3.0, 0.0f, 0.0f, 0.0f, 12.0, 6.0, 0.05, glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // wall
-
-        // Drawing ceiling
-        drawCube(ourShader, VAO, parentTrans,
-                 0.0f, 3.0f, 0.0f,                   // position (centered at the top of the room)
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 12.0f, 0.05f, 12.0f,                // scale (covering the entire room)
-                 glm::vec4(0.7f, 0.7f, 0.7f, 1.0f)); // color (light gray)
-
-        // Drawing fridge
-        drawCube(ourShader, VAO, parentTrans, -2.5, 0.5, -0.5f, 0.0f, 0.0f, 0.0f, 1.3f, 2.0f, 1.3f, glm::vec4(0.8f, 0.80f, 1.0f, 1.0f));  // lower body
-        drawCube(ourShader, VAO, parentTrans, -2.5, 1.25, -0.5f, 0.0f, 0.0f, 0.0f, 1.3f, 1.0f, 1.3f, glm::vec4(0.8f, 0.88f, 1.0f, 1.0f)); // upper body
-        drawCube(ourShader, VAO, parentTrans, -2.15, 0.5, -0.3f, 0.0f, 0.0f, 0.0f, 0.1f, 0.7f, 0.1f, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));  // lower handle
-        drawCube(ourShader, VAO, parentTrans, -2.15, 1.25, -0.3f, 0.0f, 0.0f, 0.0f, 0.1f, 0.5f, 0.1f, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f)); // lower handle
-
-        // Draw the fan
-        glm::mat4 fanTransform = glm::translate(parentTrans, glm::vec3(0.0f, 2.4f, 0.0f));                     // Move fan above the floor
-        fanTransform = glm::rotate(fanTransform, glm::radians(fanRotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate the fan around Y-axis
-
-        // Fan base
-        drawCylinder(ourShader, cylinderVAO, fanTransform,
-                     0.0f, 0.4f, 0.0f,                   // position
-                     0.0f, 0.0f, 0.0f,                   // rotation
-                     0.1f, 0.08f, 0.1f,                  // scale
-                     0.2f, 0.35f,                        // height, radius
-                     glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // red color
-
-        // Fan stand
-        drawCube(ourShader, VAO, fanTransform,
-                 -0.01f, 0.45f, 0.0f,                // position
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 0.05f, 0.5f, 0.05f,                 // scale
-                 glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // color
-
-        // Fan blades
-        for (int i = 0; i < 4; ++i)
-        {
-            glm::mat4 bladeTransform = glm::rotate(fanTransform, glm::radians(90.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
-            drawCube(ourShader, VAO, bladeTransform,
-                     0.0f, 0.4f, 0.2f,                   // position
-                     0.0f, 0.0f, 0.0f,                   // rotation
-                     0.3f, 0.08f, 0.9f,                  // scale
-                     glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // color
-        }
-
-        // Draw the flat TV
-        glm::mat4 tvTransform = glm::translate(parentTrans, glm::vec3(0.0f, 1.5f, -2.9f)); // Position the TV on the wall
-
-        // TV screen
-        drawCube(ourShader, VAO, tvTransform,
-                 0.0f, 0.0f, 0.0f,                   // position
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 1.9f, 1.0f, 0.05f,                  // scale
-                 glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // color
-
-        // TV stand
-        drawCube(ourShader, VAO, tvTransform,
-                 0.0f, -0.55f, 0.0f,                 // position
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 0.2f, 0.1f, 0.05f,                  // scale
-                 glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // color
-
-        // Draw the table lamp
-        glm::mat4 lampTransform = glm::translate(parentTrans, glm::vec3(-2.0f, 0.0f, 2.0f)); // Position the lamp on the table
-
-        // Lamp base
-        drawCube(ourShader, VAO, lampTransform,
-                 0.0f, 0.1f, 0.0f,                   // position
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 0.2f, 0.1f, 0.2f,                   // scale
-                 glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // color (dark gray)
-
-        // Lamp stand
-        drawCylinder(ourShader, cylinderVAO, lampTransform,
-                     0.0f, 0.6f, 0.0f,                                                   // position
-                     0.0f, 0.0f, 0.0f,                                                   // rotation
-                     0.05f, 0.7f, 0.05f,                                                 // scale
-                     2.0f, 0.05f,                                                        // height, radius
-                     glm::vec4(222.0f / 255.0f, 113.0f / 255.0f, 90.0f / 255.0f, 1.0f)); // color (light brown)
-
-        // Lamp shade
-        drawCylinder(ourShader, cylinderVAO, lampTransform,
-                     0.0f, 0.9f, 0.0f,                   // position
-                     0.0f, 0.0f, 0.0f,                   // rotation
-                     0.2f, 0.3f, 0.2f,                   // scale
-                     0.3f, 0.2f,                         // height, radius
-                     glm::vec4(1.0f, 1.0f, 0.8f, 1.0f)); // color (light yellow)
-
-        // Draw the tube bulb
-        glm::mat4 bulbTransform = glm::translate(parentTrans, glm::vec3(0.0f, 2.2f, -2.9f)); // Position the bulb on the wall near the ceiling
-
-        drawCylinder(ourShader, cylinderVAO, bulbTransform,
-                     0.0f, 0.0f, 0.0f,                   // position
-                     0.0f, 0.0f, 90.0f,                  // rotation (rotate to align with the wall)
-                     0.05f, 1.0f, 0.05f,                 // scale (long and thin)
-                     1.0f, 0.05f,                        // height, radius
-                     glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // color (white)
-
-        // Draw a sphere
-        drawSphere(ourShader, VAO, parentTrans,
-                   -2.0f, 0.5f, 1.0f,                  // position (adjusted y to 0.5)
-                   0.0f, 0.0f, 0.0f,                   // rotation
-                   1.0f, 1.0f, 1.0f,                   // scale
-                   0.2f,                               // radius
-                   glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // color (red)
-
-        // Draw a cone
-        drawCone(ourShader, VAO, parentTrans,
-                 -2.0f, 0.0f, 1.7f,                  // position
-                 0.0f, 0.0f, 0.0f,                   // rotation
-                 1.0f, 1.0f, 1.0f,                   // scale
-                 0.8f,                               // height
-                 0.3f,                               // radius
-                 glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // color (green)
-
-        // Activate the shader program
-        ourShader.use();
-
-        // Set the light properties in the shader
-        ourShader.setVec3("viewPos", basic_camera.Position);         // Camera position
-        ourShader.setVec3("lightPos", glm::vec3(0.0f, 2.2f, -2.9f)); // Light position
-        ourShader.setVec3("viewPos", basic_camera.Position);
-        ourShader.setVec3("lightColor", glm::vec3(0.5f, 0.5f, 0.5f)); // Dimmed light
-        //white object color
-        glm::vec3 objectColor(1.0f, 1.0f, 1.0f);
-        //glm::vec3 objectColor(1.0f, 0.5f, 0.31f);
-        ourShader.setVec3("objectColor", objectColor);
-        // Directional Light
-        ourShader.setBool("directionalLightOn", directionalLightOn);
-        ourShader.setVec3("directionalLight.direction", directionalLight.direction);
-        ourShader.setVec3("directionalLight.ambient", directionalLight.ambient);
-        ourShader.setVec3("directionalLight.diffuse", directionalLight.diffuse);
-        ourShader.setVec3("directionalLight.specular", directionalLight.specular);
-
-        // Point Light 1
-        ourShader.setBool("pointLight1On", pointLight1On);
-        ourShader.setVec3("pointLight1.position", pointLight1.position);
-        ourShader.setVec3("pointLight1.ambient", pointLight1.ambient);
-        ourShader.setVec3("pointLight1.diffuse", pointLight1.diffuse);
-        ourShader.setVec3("pointLight1.specular", pointLight1.specular);
-        ourShader.setFloat("pointLight1.constant", pointLight1.constant);
-        ourShader.setFloat("pointLight1.linear", pointLight1.linear);
-        ourShader.setFloat("pointLight1.quadratic", pointLight1.quadratic);
-
-        // Point Light 2
-        ourShader.setBool("pointLight2On", pointLight2On);
-        ourShader.setVec3("pointLight2.position", pointLight2.position);
-        ourShader.setVec3("pointLight2.ambient", pointLight2.ambient);
-        ourShader.setVec3("pointLight2.diffuse", pointLight2.diffuse);
-        ourShader.setVec3("pointLight2.specular", pointLight2.specular);
-        ourShader.setFloat("pointLight2.constant", pointLight2.constant);
-        ourShader.setFloat("pointLight2.linear", pointLight2.linear);
-        ourShader.setFloat("pointLight2.quadratic", pointLight2.quadratic);
-
-        // Spotlight
-        ourShader.setBool("spotLightOn", spotLightOn);
-        ourShader.setVec3("spotLight.position", spotLight.position);
-        ourShader.setVec3("spotLight.direction", spotLight.direction);
-        ourShader.setVec3("spotLight.ambient", spotLight.ambient);
-        ourShader.setVec3("spotLight.diffuse", spotLight.diffuse);
-        ourShader.setVec3("spotLight.specular", spotLight.specular);
-        ourShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        ourShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
-
-        // Emissive Light
-        ourShader.setBool("emissiveLightOn", emissiveLightOn);
-        ourShader.setVec3("emissiveLight.color", emissiveLight.color);
-
-        // Set the light and material uniforms
-        ourShader.setVec3("lightPos", glm::vec3(0.0f, 2.2f, -2.9f)); // Light position
-        ourShader.setVec3("viewPos", basic_camera.Position);
-        ourShader.setVec3("lightColor", glm::vec3(0.5f, 0.5f, 0.5f)); // Dimmed light
-
-        // Set the model matrix for the object
-        glm::mat4 model = glm::mat4(1.0f);
-        ourShader.setMat4("model", model);
-
-        // Set the other uniforms (e.g., view, projection)
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
+
+        // the light block is only re-uploaded when a light or toggle changed
+        int uniformScope = profiler.begin("uniforms");
+        lightBuffer.update(packLights());
+
+        // the light toggles pick the variants; a toggle to a new light set starts compiling
+        // it, and the previous variant stays in use until the new one is ready
+        const std::vector<std::string> &editedShaders = shaderWatcher.poll();
+        for (const std::string &file : editedShaders)
+            std::cout << "Shader reload: " << file << " changed" << std::endl;
+        if (!editedShaders.empty())
+            objectShaders.reload(editedShaders);
+        shaderCompiler.poll();
+        objectShaders.update();
+        uint32_t lighting = lightingVariant();
+        Shader &instancedShader = objectShaders.get(objectVariantBase | VARIANT_INSTANCED | lighting);
+        Shader &staticShader = objectShaders.get(objectVariantBase | lighting);
+        instancedUniforms.set(instancedShader, projection, view, basic_camera.Position);
+        staticUniforms.set(staticShader, projection, view, basic_camera.Position);
+        profiler.end(uniformScope);
+
+        int updateScope = profiler.begin("scene update");
+        objectRing.beginFrame();
+
+        // the room root follows the keyboard transform, the fan group its rotation;
+        // setTransform only marks a node dirty when the value actually changed
+        scene.setTransform(roomNode, glm::vec3(translate_X, translate_Y, translate_Z), glm::vec3(rotateAngle_X, rotateAngle_Y, rotateAngle_Z));
+        scene.setTransform(fanNode, glm::vec3(0.0f, 2.4f, 0.0f), glm::vec3(0.0f, fanRotateAngle_Y, 0.0f));
+        scene.updateTransforms();
+
+        if (staticBatch.needsRebuild(scene))
+        {
+            staticBatch.build(scene, roomNode, meshCache, sceneMeshes, frameArena);
+
+            // a rebuild frees the old batch; pack the arena once its free space splinters
+            if (geometryArena.fragmentation() > 0.5f && geometryArena.defragment())
+            {
+                staticBatch.relocate();
+                for (MeshHandle &mesh : sceneMeshes)
+                    meshCache.relocate(mesh);
+            }
+        }
+
+        bvh.refit(scene.worldBounds, scene.changedDrawables);
+        frustum.extract(projection * view);
+        FrameVector<unsigned char> drawableVisible(frameArena);
+        bvh.cull(frustum, scene.worldBounds, drawableVisible);
+        visibleTotal += bvh.visibleCount;
+        culledTotal += bvh.culledCount;
+
+        if (pickRequested)
+        {
+            pickRequested = false;
+            float distance = 0.0f;
+            int picked = pickDrawable(scene, bvh, meshCache, sceneMeshes, projection * view, pickX, pickY, distance);
+            if (picked >= 0)
+            {
+                int node = scene.drawables[picked];
+                std::cout << "Picked node " << node << " (" << drawGroupNames[scene.drawGroups[node]] << ") at distance " << distance << std::endl;
+            }
+            else
+            {
+                std::cout << "Picked nothing" << std::endl;
+            }
+        }
+
+        profiler.end(updateScope);
+
+        // the local lights move with the room; rebinned for every view
+        if (localLightMode != LOCAL_LIGHTS_OFF && localLightsOn)
+        {
+            ProfileScope lightScope(profiler, "light clusters");
+            clusteredLights->update(projection, view, scene.worlds[roomNode], NEAR_PLANE, FAR_PLANE, frameArena);
+        }
+
+        // queue every visible drawable; the dynamic ones are grouped by pass and mesh into
+        // one instanced item each. Depth is the distance to the nearest point of the
+        // bounding sphere along the view axis, for front-to-back order. Colors travel
+        // with each instance, so every draw uses material 0
+        int queueScope = profiler.begin("render queue");
+        unsigned int passCount = profiler.enabled ? DRAW_GROUP_COUNT : 1;
+        renderQueue.clear(scene.drawables.size());
+        FrameVector<DynamicDraw> dynamicDraws(frameArena);
+        dynamicDraws.reserve(bvh.visibleCount);
+        for (size_t slot = 0; slot < scene.drawables.size(); slot++)
+        {
+            if (!drawableVisible[slot] || staticBatch.batched[slot])
+                continue;
+            int i = scene.drawables[slot];
+            unsigned int pass = profiler.enabled ? scene.drawGroups[i] : 0;
+            Bounds bounds = scene.worldBounds.get(slot);
+            float viewDepth = -(view * glm::vec4(bounds.center, 1.0f)).z - bounds.radius;
+            dynamicDraws.push_back({RenderQueue::makeKey(pass, RENDER_PROGRAM_INSTANCED, scene.meshes[i], 0, viewDepth / FAR_PLANE), i});
+        }
+
+        // the static room is culled as a whole and drawn with the room's world matrix
+        Bounds staticBounds = transformBounds(staticBatch.bounds, scene.worlds[roomNode]);
+        if (staticBatch.indexCount > 0 && frustum.intersects(staticBounds))
+        {
+            ObjectBlockData object = {scene.worlds[roomNode], glm::vec4(1.0f), glm::mat3x4(scene.normalWorlds[roomNode])};
+            GLintptr objectOffset = objectRing.push(&object);
+            float staticDepth = (-(view * glm::vec4(staticBounds.center, 1.0f)).z - staticBounds.radius) / FAR_PLANE;
+            unsigned int pass = profiler.enabled ? DRAW_GROUP_STATIC : 0;
+            if (objectOffset >= 0)
+                renderQueue.add({RenderQueue::makeKey(pass, RENDER_PROGRAM_STATIC, STATIC_BATCH_MESH, 0, staticDepth),
+                                 staticShader.ID, staticBatch.VAO, staticBatch.indexCount, 0, objectOffset,
+                                 staticBatch.firstIndex, staticBatch.baseVertex, 0});
+        }
+        objectRing.flush();
+
+        // every pass and mesh appends its instances, front to back, to the one instance
+        // stream of the frame; its item finds them by base instance and sorts by the
+        // nearest one. The queue writes the multi-draw commands while sorting
+        std::sort(dynamicDraws.begin(), dynamicDraws.end(), [](const DynamicDraw &a, const DynamicDraw &b)
+                  { return a.key < b.key || (a.key == b.key && a.node < b.node); });
+        instances.begin();
+        for (size_t first = 0, last = 0; first < dynamicDraws.size(); first = last)
+        {
+            uint64_t group = dynamicDraws[first].key >> RenderQueue::MATERIAL_SHIFT;
+            unsigned int firstInstance = instances.size();
+            for (last = first; last < dynamicDraws.size() && dynamicDraws[last].key >> RenderQueue::MATERIAL_SHIFT == group; last++)
+            {
+                int node = dynamicDraws[last].node;
+                instances.add(scene.worlds[node], scene.normalWorlds[node], scene.colors[node]);
+            }
+            GLsizei instanceCount = (GLsizei)(instances.size() - firstInstance);
+            if (instanceCount == 0)
+                continue;
+            const MeshHandle &handle = sceneMeshes[scene.meshes[dynamicDraws[first].node]];
+            renderQueue.add({dynamicDraws[first].key, instancedShader.ID, handle.VAO, (GLsizei)handle.indexCount, instanceCount, -1,
+                             handle.placement.firstIndex, handle.placement.baseVertex, instances.baseInstance(firstInstance)});
+        }
+        instances.upload();
+        renderQueue.sort();
+        profiler.end(queueScope);
+
+        // the state cache drops the program and VAO binds repeated between items
+        auto submitStart = chrono::steady_clock::now();
+        for (unsigned int pass = 0; pass < passCount; pass++)
+        {
+            ProfileScope passScope(profiler, drawGroupNames[pass]);
+            renderQueue.submitPass(objectRing, pass);
+        }
+        double submitMs = chrono::duration<double, milli>(chrono::steady_clock::now() - submitStart).count();
+        unsigned int drawCalls = renderQueue.drawCalls;
+        queueItemsTotal += renderQueue.items.size();
+        commandsTotal += multiDraw.commandsDrawn;
+        multiDrawCallsTotal += multiDraw.drawCalls;
+        objectRing.endFrame();
+        instances.end();
+        multiDraw.end();
+
+        if (benchmark)
+        {
+            gpuTimer.end();
+            double cpuMs = chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count();
+            unsigned int uniformUploads = objectShaders.uniformUploads() - uniformUploadsBefore +
+                                          lightBuffer.frameUploads + objectRing.frameUploads;
+            benchmarkReport.addFrame(cpuMs, submitMs, drawCalls, uniformUploads, glState.frameIssued);
+        }
+
+        // the mesh cache is warmed before the loop, so no frame should create GL objects
+        if (meshCache.frameGLObjectsCreated != 0)
+            std::cout << "WARNING::MESH_CACHE: frame " << frameCount << " created " << meshCache.frameGLObjectsCreated << " GL objects" << std::endl;
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+        // transient data lives in the frame arena, so a steady-state frame shouldn't touch the heap
+        unsigned long long frameAllocations = heapAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+        if (frameCount >= STEADY_STATE_FRAME && !profiler.enabled && frameAllocations > 0)
+        {
+            if (steadyStateAllocations == 0)
+                std::cout << "WARNING::FRAME_ARENA: frame " << frameCount << " made " << frameAllocations << " heap allocations" << std::endl;
+            steadyStateAllocations += frameAllocations;
+        }
+#endif
+        if (frameCount == 0)
+            firstFrameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - programStart).count();
+        frameCount++;
+
+        profiler.end(frameScope);
+        profiler.endFrame();
 
         // Swap buffers and poll IO events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (window != NULL)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        else
+        {
+            // stands in for the swap: hands the frame to the driver
+            glFlush();
+        }
     }
 
+    if (headless)
+    {
+        glFinish();
+        if (headlessImage != NULL && offscreen.savePPM(headlessImage))
+            std::cout << "Headless: wrote frame " << frameCount << " to " << headlessImage << std::endl;
+    }
+    if (benchmark)
+    {
+        gpuTimer.drain();
+        if (benchmarkReport.writeJSON(benchmarkResults, benchmarkPath, BENCHMARK_WARMUP_FRAMES, FIXED_TIMESTEP, gpuTimer.frameMs))
+            std::cout << "Benchmark: " << frameCount - BENCHMARK_WARMUP_FRAMES << " frames written to " << benchmarkResults << std::endl;
+    }
+
+    if (profiler.enabled)
+    {
+        profiler.finish();
+        profiler.printBreakdown();
+        if (profiler.writeChromeTrace(profileTrace))
+            std::cout << "Profiler: " << profiler.framesResolved << " frames (" << profiler.framesDropped << " dropped) written to " << profileTrace << std::endl;
+    }
+
+    if (frameCount > 0)
+        std::cout << "Frustum culling: " << (double)visibleTotal / frameCount << " visible, " << (double)culledTotal / frameCount
+                  << " culled per frame (" << scene.drawables.size() << " drawables, BVH depth " << bvh.depth << ")" << std::endl;
+    if (frameCount > 0)
+    {
+        std::cout << "Render queue: " << (double)queueItemsTotal / frameCount << " items per frame" << std::endl;
+        std::cout << "Multi-draw: " << (multiDraw.indirect ? "indirect" : "one draw per command") << ", " << (double)commandsTotal / frameCount
+                  << " commands in " << (double)multiDrawCallsTotal / frameCount << " draw calls per frame" << std::endl;
+        glState.printCounts(frameCount);
+    }
+    std::cout << "Static batch: " << staticBatch.objectsBatched << " objects, " << staticBatch.indexCount / 3 << " triangles, "
+              << staticBatch.builds << " builds over " << frameCount << " frames" << std::endl;
+    if (objectRing.persistent)
+        std::cout << "Object ring: persistent mapping, " << objectRing.fenceWaits << " fence waits over " << frameCount << " frames" << std::endl;
+    else
+        std::cout << "Object ring: own buffer orphaned before each upload, " << objectRing.uploads << " uploads over " << frameCount
+                  << " frames" << std::endl;
+    static const char *const compileModes[] = {"synchronous", "parallel in the driver", "worker thread"};
+    std::cout << "Shaders: first frame submitted " << firstFrameMs << " ms after start; " << objectShaders.variantsBuilt
+              << " variants, " << objectShaders.buildMs << " ms of it on the render thread; ";
+    if (programCache.enabled)
+        std::cout << programCache.hits << " loaded from the binary cache, " << programCache.stores << " compiled and stored, "
+                  << programCache.rejects << " cached binaries rejected" << std::endl;
+    else
+        std::cout << "compiled without the binary cache" << std::endl;
+    std::cout << "Shader compiler: " << compileModes[shaderCompiler.mode] << ", " << shaderCompiler.programsBuilt << " programs ready in "
+              << (shaderCompiler.programsBuilt > 0 ? shaderCompiler.latencyMs / shaderCompiler.programsBuilt : 0.0)
+              << " ms on average, " << shaderCompiler.waits << " waited for, " << objectShaders.fallbacksUsed << " lookups answered by a fallback" << std::endl;
+    if (shaderWatcher.watching)
+        std::cout << "Shader reload: " << shaderWatcher.changes << " edited files, " << objectShaders.reloads << " variants rebuilt, "
+                  << objectShaders.reloadFailures << " failed and kept their previous program" << std::endl;
+    std::cout << "Light block: " << lightBuffer.uploads << " uploads over " << frameCount << " frames" << std::endl;
+    if (clusteredLights && clusteredLights->updates > 0)
+        std::cout << "Local lights: " << clusteredLights->lights.size() << ", "
+                  << (clusteredLights->clustered ? "clustered" : "every light per fragment") << "; "
+                  << clusteredLights->assignMs / clusteredLights->updates << " ms CPU per frame, "
+                  << (double)clusteredLights->referencesTotal / clusteredLights->updates << " list entries in "
+                  << ClusteredLights::CLUSTER_COUNT << " clusters per frame, at most " << clusteredLights->maxPerCluster
+                  << " lights in one cluster, " << clusteredLights->dropped << " entries dropped" << std::endl;
+    std::cout << "Frame arena: " << frameArena.highWater / 1024.0 << " KB high-water of " << frameArena.capacity() / 1024.0 << " KB, "
+              << frameArena.overflows << " overflows, " << frameArena.grows << " grows";
+#ifdef COUNT_HEAP_ALLOCATIONS
+    std::cout << "; " << steadyStateAllocations << " heap allocations in steady-state frames";
+#endif
+    std::cout << std::endl;
+    geometryArena.printStats("Geometry arena");
+    streamArena.printStats("Stream arena");
+    std::cout << "Mesh cache: " << meshCache.meshesBuilt << " meshes, " << meshCache.vertexBytes / 1024.0 << " KB of "
+              << (vertexEncoding == VERTEX_COMPACT ? "compact" : "float") << " vertices (" << meshCache.arena.layout.stride
+              << " bytes each), " << meshCache.glObjectsCreated << " GL objects, "
+              << meshCache.lookups << " lookups, " << meshCache.misses << " misses over " << frameCount << " frames" << std::endl;
+
     // De-allocate resources
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    gpuTimer.release();
+    profiler.release();
+    objectRing.release();
+    lightBuffer.release();
+    if (clusteredLights)
+        clusteredLights->release();
+    shaderCompiler.stop();
+    objectShaders.release();
+    multiDraw.release();
+    instances.release();
+    staticBatch.release();
+    meshCache.release();
+    geometryArena.release();
+    streamArena.release();
+    offscreen.release();
 
     // Terminate GLFW
-    glfwTerminate();
+    if (workerWindow != NULL)
+        glfwDestroyWindow(workerWindow);
+    if (window != NULL)
+        glfwTerminate();
+#ifdef HEADLESS_EGL
+    headlessContext.release();
+#endif
     return 0;
 }
 
@@ -656,6 +1114,19 @@ void processInput(GLFWwindow *window)
 
     if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
         specularOn = !specularOn;
+
+    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
+        localLightsOn = !localLightsOn;
+}
+
+// Mouse button callback: a left click picks the object under the cursor
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    {
+        glfwGetCursorPos(window, &pickX, &pickY);
+        pickRequested = true;
+    }
 }
 
 // Framebuffer size callback
@@ -670,326 +1141,314 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
     basic_camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-// Draw Cylinder Function
-void drawCylinder(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-                  float posX, float posY, float posZ,
-                  float rotX, float rotY, float rotZ,
-                  float scX, float scY, float scZ,
-                  float height, float radius, glm::vec4 color)
-{
-    shaderProgram.use();
-    std::vector<float> cylinderVertices;
-    std::vector<unsigned int> cylinderIndices;
-    int segments = 36;
-    generateCylinderVertices(cylinderVertices, cylinderIndices, segments, height, radius);
-
-    // Apply transformations: translation, rotation, scaling
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, model, modelCentered;
-    translateMatrix = glm::translate(parentTrans, glm::vec3(posX, posY, posZ));
-    rotateXMatrix = glm::rotate(translateMatrix, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotateYMatrix = glm::rotate(rotateXMatrix, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotateZMatrix = glm::rotate(rotateYMatrix, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(rotateZMatrix, glm::vec3(scX, scY, scZ));
-    modelCentered = glm::translate(model, glm::vec3(-0.25f, -0.25f, -0.25f));
-
-    // Set the model transformation in the shader
-    shaderProgram.setMat4("model", modelCentered);
-
-    // Use the custom color passed to the function
-    shaderProgram.setVec4("color", color);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, cylinderIndices.size(), GL_UNSIGNED_INT, 0);
-}
-
-// Draw Cube Function
-void drawCube(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-              float posX, float posY, float posZ,
-              float rotX, float rotY, float rotZ,
-              float scX, float scY, float scZ,
-              glm::vec4 color)
+// Pick the closest drawable along the view ray through a window position
+int pickDrawable(const Scene &scene, BVH &bvh, const MeshCache &meshCache, const MeshHandle *sceneMeshes,
+                 const glm::mat4 &viewProjection, double x, double y, float &distance)
 {
-    shaderProgram.use();
-
-    // Apply transformations: translation, rotation, scaling
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, model, modelCentered;
-    translateMatrix = glm::translate(parentTrans, glm::vec3(posX, posY, posZ));
-    rotateXMatrix = glm::rotate(translateMatrix, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotateYMatrix = glm::rotate(rotateXMatrix, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotateZMatrix = glm::rotate(rotateYMatrix, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(rotateZMatrix, glm::vec3(scX, scY, scZ));
-    modelCentered = glm::translate(model, glm::vec3(-0.25f, -0.25f, -0.25f));
-
-    // Set the model transformation in the shader
-    shaderProgram.setMat4("model", modelCentered);
-
-    // Use the custom color passed to the function
-    shaderProgram.setVec4("color", color);
-
-    // Draw the cube
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    // ray from the near to the far plane through the cursor
+    glm::vec2 ndc(2.0f * (float)x / SCR_WIDTH - 1.0f, 1.0f - 2.0f * (float)y / SCR_HEIGHT);
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    distance = 1000.0f;
+    return bvh.raycast(origin, direction, distance, [&](int slot, float &hitDistance)
+    {
+        // cheap reject against the bounding sphere first
+        Bounds bounds = scene.worldBounds.get(slot);
+        float sphereDistance;
+        bool insideSphere = glm::distance(origin, bounds.center) <= bounds.radius;
+        if (!insideSphere && !glm::intersectRaySphere(origin, direction, bounds.center, bounds.radius * bounds.radius, sphereDistance))
+            return false;
+
+        int node = scene.drawables[slot];
+        const MeshGeometry *geometry = meshCache.getGeometry(sceneMeshes[scene.meshes[node]]);
+        if (geometry == NULL)
+            return false;
+
+        // triangles are tested in the mesh's local space; the ray parameter is the same there
+        glm::mat4 toLocal = glm::inverse(scene.worlds[node]);
+        glm::vec3 localOrigin = glm::vec3(toLocal * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(toLocal * glm::vec4(direction, 0.0f));
+        bool hit = false;
+        for (size_t i = 0; i + 2 < geometry->indices.size(); i += 3)
+        {
+            glm::vec2 barycentric;
+            float triangleDistance;
+            if (glm::intersectRayTriangle(localOrigin, localDirection,
+                                          geometry->positions[geometry->indices[i]],
+                                          geometry->positions[geometry->indices[i + 1]],
+                                          geometry->positions[geometry->indices[i + 2]],
+                                          barycentric, triangleDistance) &&
+                triangleDistance >= 0.0f && triangleDistance < hitDistance)
+            {
+                hitDistance = triangleDistance;
+                hit = true;
+            }
+        }
+        return hit;
+    });
 }
 
-void generateCylinderVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, float height, float radius)
+// Pack the light set and its toggles into the LightBlock layout
+LightBlockData packLights()
 {
-    // Top center vertex
-    vertices.push_back(0.0f);
-    vertices.push_back(height / 2.0f);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.702f); // r
-    vertices.push_back(1.0f);   // g
-    vertices.push_back(1.0f);   // b
-
-    // Bottom center vertex
-    vertices.push_back(0.0f);
-    vertices.push_back(-height / 2.0f);
-    vertices.push_back(0.0f);
-    vertices.push_back(0.702f); // r
-    vertices.push_back(1.0f);   // g
-    vertices.push_back(1.0f);   // b
-
-    // Generate vertices around the top and bottom circles
-    for (int i = 0; i <= segments; i++)
+    LightBlockData data;
+
+    // Directional Light
+    data.directionalLight.direction = glm::vec4(directionalLight.direction, 0.0f);
+    data.directionalLight.ambient = glm::vec4(directionalLight.ambient, 0.0f);
+    data.directionalLight.diffuse = glm::vec4(directionalLight.diffuse, 0.0f);
+    data.directionalLight.specular = glm::vec4(directionalLight.specular, 0.0f);
+
+    // Point Lights
+    const PointLight *points[NR_POINT_LIGHTS] = {&pointLight1, &pointLight2};
+    const bool pointsOn[NR_POINT_LIGHTS] = {pointLight1On, pointLight2On};
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
     {
-        float angle = 2.0f * 3.1416 * i / segments;
-        float x = radius * cos(angle);
-        float z = radius * sin(angle);
-
-        // Top circle vertex
-        vertices.push_back(x);
-        vertices.push_back(height / 2.0f);
-        vertices.push_back(z);
-        vertices.push_back(0.702f); // r
-        vertices.push_back(1.0f);   // g
-        vertices.push_back(1.0f);   // b
-
-        // Bottom circle vertex
-        vertices.push_back(x);
-        vertices.push_back(-height / 2.0f);
-        vertices.push_back(z);
-        vertices.push_back(0.702f); // r
-        vertices.push_back(1.0f);   // g
-        vertices.push_back(1.0f);   // b
+        data.pointLights[i].position = glm::vec4(points[i]->position, 1.0f);
+        data.pointLights[i].ambient = glm::vec4(points[i]->ambient, 0.0f);
+        data.pointLights[i].diffuse = glm::vec4(points[i]->diffuse, 0.0f);
+        data.pointLights[i].specular = glm::vec4(points[i]->specular, 0.0f);
+        data.pointLights[i].attenuation = glm::vec4(points[i]->constant, points[i]->linear, points[i]->quadratic, pointsOn[i] ? 1.0f : 0.0f);
     }
 
-    // Generate indices for the top and bottom circles
-    for (int i = 0; i < segments; i++)
-    {
-        // Top circle
-        indices.push_back(0);
-        indices.push_back(2 + 2 * i);
-        indices.push_back(2 + 2 * ((i + 1) % segments));
-
-        // Bottom circle
-        indices.push_back(1);
-        indices.push_back(3 + 2 * i);
-        indices.push_back(3 + 2 * ((i + 1) % segments));
-
-        // Side triangles
-        int top1 = 2 + 2 * i;
-        int top2 = 2 + 2 * ((i + 1) % segments);
-        int bottom1 = top1 + 1;
-        int bottom2 = top2 + 1;
-
-        indices.push_back(top1);
-        indices.push_back(bottom1);
-        indices.push_back(top2);
-
-        indices.push_back(bottom1);
-        indices.push_back(bottom2);
-        indices.push_back(top2);
-    }
+    // Spotlight
+    data.spotLight.position = glm::vec4(spotLight.position, 1.0f);
+    data.spotLight.direction = glm::vec4(spotLight.direction, 0.0f);
+    data.spotLight.ambient = glm::vec4(spotLight.ambient, 0.0f);
+    data.spotLight.diffuse = glm::vec4(spotLight.diffuse, 0.0f);
+    data.spotLight.specular = glm::vec4(spotLight.specular, 0.0f);
+    data.spotLight.cutOff = glm::vec4(spotLight.cutOff, spotLight.outerCutOff, 0.0f, spotLightOn ? 1.0f : 0.0f);
+
+    // Emissive Light
+    data.emissiveLight = glm::vec4(emissiveLight.color, emissiveLightOn ? 1.0f : 0.0f);
+
+    data.lightSwitches = glm::vec4(directionalLightOn ? 1.0f : 0.0f,
+                                   ambientOn ? 1.0f : 0.0f,
+                                   diffuseOn ? 1.0f : 0.0f,
+                                   specularOn ? 1.0f : 0.0f);
+    return data;
 }
 
-void generateSphereVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, int rings, float radius)
+// Lights and terms that are on, as the lighting fields of OBJECT_VARIANT_DEFINES
+uint32_t lightingVariant()
 {
-    for (int i = 0; i <= rings; ++i)
-    {
-        float theta = i * glm::pi<float>() / rings;
-        float sinTheta = sin(theta);
-        float cosTheta = cos(theta);
-
-        for (int j = 0; j <= segments; ++j)
-        {
-            float phi = j * 2 * glm::pi<float>() / segments;
-            float sinPhi = sin(phi);
-            float cosPhi = cos(phi);
-
-            float x = cosPhi * sinTheta;
-            float y = cosTheta;
-            float z = sinPhi * sinTheta;
-            float u = 1 - (float)j / segments;
-            float v = 1 - (float)i / rings;
+    uint32_t bits = directionalLightOn ? 1 : 0;
+    bits |= (pointLight1On ? 1 : 0) << 1;
+    bits |= (pointLight2On ? 1 : 0) << 2;
+    bits |= (spotLightOn ? 1 : 0) << (1 + NR_POINT_LIGHTS);
+    bits |= (ambientOn ? 1 : 0) << (2 + NR_POINT_LIGHTS);
+    bits |= (diffuseOn ? 1 : 0) << (3 + NR_POINT_LIGHTS);
+    bits |= (specularOn ? 1 : 0) << (4 + NR_POINT_LIGHTS);
+    bits |= (localLightsOn ? (uint32_t)localLightMode : 0) << (5 + NR_POINT_LIGHTS);
+    return bits << VARIANT_LIGHTING_SHIFT;
+}
 
-            vertices.push_back(radius * x);
-            vertices.push_back(radius * y);
-            vertices.push_back(radius * z);
-            vertices.push_back(u);
-            vertices.push_back(v);
-        }
-    }
+// Scatter the local lights through the room with a fixed seed, so runs compare;
+// every fourth is a spot light pointing down
+void scatterLocalLights(std::vector<LocalLight> &lights, unsigned int count)
+{
+    uint32_t seed = 12345u;
+    auto random = [&seed](float low, float high)
+    {
+        seed = seed * 1664525u + 1013904223u; // LCG
+        return low + (high - low) * (float)(seed >> 8) / 16777216.0f;
+    };
 
-    for (int i = 0; i < rings; ++i)
+    lights.clear();
+    for (unsigned int i = 0; i < count; i++)
     {
-        for (int j = 0; j < segments; ++j)
+        LocalLight light;
+        light.position = glm::vec3(random(-2.8f, 2.8f), random(0.1f, 2.9f), random(-2.8f, 2.8f));
+        light.range = random(0.5f, 1.2f);
+        light.color = glm::vec3(random(0.1f, 1.0f), random(0.1f, 1.0f), random(0.1f, 1.0f)) * 0.8f;
+        if (i % 4 == 3)
         {
-            int first = (i * (segments + 1)) + j;
-            int second = first + segments + 1;
-
-            indices.push_back(first);
-            indices.push_back(second);
-            indices.push_back(first + 1);
-
-            indices.push_back(second);
-            indices.push_back(second + 1);
-            indices.push_back(first + 1);
+            light.range *= 2.0f;
+            light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            light.outerCone = random(20.0f, 35.0f);
+            light.innerCone = light.outerCone * 0.7f;
         }
+        lights.push_back(light);
     }
 }
 
-void drawSphere(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-                float posX, float posY, float posZ,
-                float rotX, float rotY, float rotZ,
-                float scX, float scY, float scZ,
-                float radius, glm::vec4 color)
-{
-    shaderProgram.use();
-    std::vector<float> sphereVertices;
-    std::vector<unsigned int> sphereIndices;
-    int segments = 36;
-    int rings = 18;
-    generateSphereVertices(sphereVertices, sphereIndices, segments, rings, radius);
-
-    unsigned int sphereVAO, sphereVBO, sphereEBO;
-    glGenVertexArrays(1, &sphereVAO);
-    glGenBuffers(1, &sphereVBO);
-    glGenBuffers(1, &sphereEBO);
-
-    glBindVertexArray(sphereVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), &sphereVertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned int), &sphereIndices[0], GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-
-    // texture coordinate attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // Apply transformations: translation, rotation, scaling
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, model, modelCentered;
-    translateMatrix = glm::translate(parentTrans, glm::vec3(posX, posY, posZ));
-    rotateXMatrix = glm::rotate(translateMatrix, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotateYMatrix = glm::rotate(rotateXMatrix, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotateZMatrix = glm::rotate(rotateYMatrix, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(rotateZMatrix, glm::vec3(scX, scY, scZ));
-    modelCentered = glm::translate(model, glm::vec3(-0.25f, -0.25f, -0.25f));
-
-    // Set the model transformation in the shader
-    shaderProgram.setMat4("model", modelCentered);
-
-    // Use the custom color passed to the function
-    shaderProgram.setVec4("color", color);
-
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_INT, 0);
-
-    // De-allocate resources
-    glDeleteVertexArrays(1, &sphereVAO);
-    glDeleteBuffers(1, &sphereVBO);
-    glDeleteBuffers(1, &sphereEBO);
-}
-
-void generateConeVertices(std::vector<float> &vertices, std::vector<unsigned int> &indices, int segments, float height, float radius)
+// Build the room: every piece of furniture as a node under one root
+int buildRoom(Scene &scene, int &fan)
 {
-    // Generate vertices for the base
-    for (int i = 0; i <= segments; ++i)
+    // root; follows the keyboard translation and rotation every frame
+    int room = scene.addGroup(-1);
+
+    // Drawing Table
+    scene.nextDrawGroup = DRAW_GROUP_FURNITURE;
+    // scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 3.0f, 0.2f, 3.0f, glm::vec4(0.72f, 0.52f, 0.04f, 1.0f)); // wooden surface
+    scene.addMesh(PRIMITIVE_CYLINDER, room,
+                  0.5f, 0.5f, 0.5f,  // position
+                  0.0f, 0.0f, 0.0f,  // rotation
+                  1.9f, 0.04f, 1.9f, // scale
+                  glm::vec4(0.72f, 0.52f, 0.04f, 1.0f));
+
+    // cylindrical leg
+    scene.addMesh(PRIMITIVE_CYLINDER, room,
+                  0.0f, 0.36f, 0.0f, // position
+                  0.0f, 0.0f, 0.0f,  // rotation
+                  0.3f, 0.56f, 0.3f, // scale
+                  glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+
+    // Chair 1 (Front)
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.25f, 0.9f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.2f, 0.1f, 0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.2f, 0.1f, 0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.2f, 0.1f, 1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.2f, 0.1f, 1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.4f, 1.13f, 0.0f, 90.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f)); // backrest
+
+    // Chair 2 (Back)
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.25f, -0.9f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f));  // wooden seat
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.2f, 0.1f, -0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.2f, 0.1f, -0.7f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));    // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.2f, 0.1f, -1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));    // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.2f, 0.1f, -1.1f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.4f, -1.13f, 0.0f, -90.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f)); // backrest
+
+    // Chair 3 (Right)
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.9f, 0.25f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.7f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.7f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 1.1f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 1.1f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, 1.13f, 0.4f, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // backrest
+
+    // Chair 4 (Left)
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.9f, 0.25f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.2f, 1.0f, glm::vec4(0.54f, 0.27f, 0.07f, 1.0f)); // wooden seat
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.7f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -0.7f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -1.1f, 0.1f, 0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));   // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -1.1f, 0.1f, -0.2f, 0.0f, 0.0f, 0.0f, 0.2f, 0.5f, 0.2f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // leg
+    scene.addMesh(PRIMITIVE_CUBE, room, -1.13f, 0.4f, 0.0f, 0.0f, 0.0f, 0.0f, 0.1f, 0.8f, 1.0f, glm::vec4(0.4f, 0.26f, 0.13f, 1.0f));  // backrest
+
+    // Drawing floor
+    scene.nextDrawGroup = DRAW_GROUP_WALLS;
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 12.0, 0.05, 12.0, glm::vec4(0.7f, 0.7f, 0.7f, 1.0f));
+
+    // Drawing walls
+    scene.addMesh(PRIMITIVE_CUBE, room, -3.0, 1.5, 0.0f, 0.0f, 0.0f, 0.0f, 0.05, 6.0, 12.0, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // wall
+    scene.addMesh(PRIMITIVE_CUBE, room, 3.0, 1.5, 0.0f, 0.0f, 0.0f, 0.0f, 0.05, 6.0, 12.0, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));  // wall
+    scene.addMesh(PRIMITIVE_CUBE, room, 0.0f, 1.5, -3.0, 0.0f, 0.0f, 0.0f, 12.0, 6.0, 0.05, glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // wall
+
+    // Drawing ceiling
+    scene.addMesh(PRIMITIVE_CUBE, room,
+                  0.0f, 3.0f, 0.0f,                   // position (centered at the top of the room)
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  12.0f, 0.05f, 12.0f,                // scale (covering the entire room)
+                  glm::vec4(0.7f, 0.7f, 0.7f, 1.0f)); // color (light gray)
+
+    // Drawing fridge
+    scene.nextDrawGroup = DRAW_GROUP_FURNITURE;
+    scene.addMesh(PRIMITIVE_CUBE, room, -2.5, 0.5, -0.5f, 0.0f, 0.0f, 0.0f, 1.3f, 2.0f, 1.3f, glm::vec4(0.8f, 0.80f, 1.0f, 1.0f));  // lower body
+    scene.addMesh(PRIMITIVE_CUBE, room, -2.5, 1.25, -0.5f, 0.0f, 0.0f, 0.0f, 1.3f, 1.0f, 1.3f, glm::vec4(0.8f, 0.88f, 1.0f, 1.0f)); // upper body
+    scene.addMesh(PRIMITIVE_CUBE, room, -2.15, 0.5, -0.3f, 0.0f, 0.0f, 0.0f, 0.1f, 0.7f, 0.1f, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));  // lower handle
+    scene.addMesh(PRIMITIVE_CUBE, room, -2.15, 1.25, -0.3f, 0.0f, 0.0f, 0.0f, 0.1f, 0.5f, 0.1f, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f)); // lower handle
+
+    // Draw the fan
+    scene.nextDrawGroup = DRAW_GROUP_FAN;
+    fan = scene.addGroup(room, 0.0f, 2.4f, 0.0f); // Move fan above the floor; rotated around Y-axis every frame
+    scene.setMovable(fan);
+
+    // Fan base
+    scene.addMesh(PRIMITIVE_CYLINDER, fan,
+                  0.0f, 0.4f, 0.0f,                   // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  0.1f, 0.08f, 0.1f,                  // scale
+                  glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // red color
+
+    // Fan stand
+    scene.addMesh(PRIMITIVE_CUBE, fan,
+                  -0.01f, 0.45f, 0.0f,                // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  0.05f, 0.5f, 0.05f,                 // scale
+                  glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // color
+
+    // Fan blades
+    for (int i = 0; i < 4; ++i)
     {
-        float theta = i * 2.0f * glm::pi<float>() / segments;
-        float x = radius * cos(theta);
-        float z = radius * sin(theta);
-        vertices.push_back(x);
-        vertices.push_back(0.0f);
-        vertices.push_back(z);
+        int blade = scene.addGroup(fan, 0.0f, 0.0f, 0.0f, 0.0f, 90.0f * i, 0.0f);
+        scene.addMesh(PRIMITIVE_CUBE, blade,
+                      0.0f, 0.4f, 0.2f,                   // position
+                      0.0f, 0.0f, 0.0f,                   // rotation
+                      0.3f, 0.08f, 0.9f,                  // scale
+                      glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)); // color
     }
 
-    // Add the apex vertex
-    vertices.push_back(0.0f);
-    vertices.push_back(height);
-    vertices.push_back(0.0f);
-
-    // Generate indices for the base
-    for (int i = 0; i < segments; ++i)
-    {
-        indices.push_back(i);
-        indices.push_back((i + 1) % segments);
-        indices.push_back(segments);
-    }
-
-    // Generate indices for the sides
-    for (int i = 0; i < segments; ++i)
-    {
-        indices.push_back(i);
-        indices.push_back((i + 1) % segments);
-        indices.push_back(segments + 1);
-    }
+    // Draw the flat TV
+    scene.nextDrawGroup = DRAW_GROUP_FURNITURE;
+    int tv = scene.addGroup(room, 0.0f, 1.5f, -2.9f); // Position the TV on the wall
+
+    // TV screen
+    scene.addMesh(PRIMITIVE_CUBE, tv,
+                  0.0f, 0.0f, 0.0f,                   // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  1.9f, 1.0f, 0.05f,                  // scale
+                  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)); // color
+
+    // TV stand
+    scene.addMesh(PRIMITIVE_CUBE, tv,
+                  0.0f, -0.55f, 0.0f,                 // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  0.2f, 0.1f, 0.05f,                  // scale
+                  glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // color
+
+    // Draw the table lamp
+    scene.nextDrawGroup = DRAW_GROUP_LAMP;
+    int lamp = scene.addGroup(room, -2.0f, 0.0f, 2.0f); // Position the lamp on the table
+
+    // Lamp base
+    scene.addMesh(PRIMITIVE_CUBE, lamp,
+                  0.0f, 0.1f, 0.0f,                   // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  0.2f, 0.1f, 0.2f,                   // scale
+                  glm::vec4(0.3f, 0.3f, 0.3f, 1.0f)); // color (dark gray)
+
+    // Lamp stand
+    scene.addMesh(PRIMITIVE_CYLINDER, lamp,
+                  0.0f, 0.6f, 0.0f,                                                   // position
+                  0.0f, 0.0f, 0.0f,                                                   // rotation
+                  0.05f, 0.7f, 0.05f,                                                 // scale
+                  glm::vec4(222.0f / 255.0f, 113.0f / 255.0f, 90.0f / 255.0f, 1.0f)); // color (light brown)
+
+    // Lamp shade
+    scene.addMesh(PRIMITIVE_CYLINDER, lamp,
+                  0.0f, 0.9f, 0.0f,                   // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  0.2f, 0.3f, 0.2f,                   // scale
+                  glm::vec4(1.0f, 1.0f, 0.8f, 1.0f)); // color (light yellow)
+
+    // Draw the tube bulb
+    int bulb = scene.addGroup(room, 0.0f, 2.2f, -2.9f); // Position the bulb on the wall near the ceiling
+
+    scene.addMesh(PRIMITIVE_CYLINDER, bulb,
+                  0.0f, 0.0f, 0.0f,                   // position
+                  0.0f, 0.0f, 90.0f,                  // rotation (rotate to align with the wall)
+                  0.05f, 1.0f, 0.05f,                 // scale (long and thin)
+                  glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)); // color (white)
+
+    // Draw a sphere
+    scene.nextDrawGroup = DRAW_GROUP_FURNITURE;
+    scene.addMesh(PRIMITIVE_SPHERE, room,
+                  -2.0f, 0.5f, 1.0f,                  // position (adjusted y to 0.5)
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  1.0f, 1.0f, 1.0f,                   // scale
+                  glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // color (red)
+
+    // Draw a cone
+    scene.addMesh(PRIMITIVE_CONE, room,
+                  -2.0f, 0.0f, 1.7f,                  // position
+                  0.0f, 0.0f, 0.0f,                   // rotation
+                  1.0f, 1.0f, 1.0f,                   // scale
+                  glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // color (green)
+
+    return room;
 }
-
-void drawCone(Shader shaderProgram, unsigned int VAO, glm::mat4 parentTrans,
-              float posX, float posY, float posZ,
-              float rotX, float rotY, float rotZ,
-              float scX, float scY, float scZ,
-              float height, float radius, glm::vec4 color)
-{
-    shaderProgram.use();
-    std::vector<float> coneVertices;
-    std::vector<unsigned int> coneIndices;
-    int segments = 36;
-    generateConeVertices(coneVertices, coneIndices, segments, height, radius);
-
-    unsigned int coneVAO, coneVBO, coneEBO;
-    glGenVertexArrays(1, &coneVAO);
-    glGenBuffers(1, &coneVBO);
-    glGenBuffers(1, &coneEBO);
-
-    glBindVertexArray(coneVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
-    glBufferData(GL_ARRAY_BUFFER, coneVertices.size() * sizeof(float), &coneVertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coneEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, coneIndices.size() * sizeof(unsigned int), &coneIndices[0], GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-
-    // Apply transformations: translation, rotation, scaling
-    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, model, modelCentered;
-    translateMatrix = glm::translate(parentTrans, glm::vec3(posX, posY, posZ));
-    rotateXMatrix = glm::rotate(translateMatrix, glm::radians(rotX), glm::vec3(1.0f, 0.0f, 0.0f));
-    rotateYMatrix = glm::rotate(rotateXMatrix, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
-    rotateZMatrix = glm::rotate(rotateYMatrix, glm::radians(rotZ), glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(rotateZMatrix, glm::vec3(scX, scY, scZ));
-    modelCentered = glm::translate(model, glm::vec3(-0.25f, -0.25f, -0.25f));
-
-    // Set the model transformation in the shader
-    shaderProgram.setMat4("model", modelCentered);
-
-    // Use the custom color passed to the function
-    shaderProgram.setVec4("color", color);
-
-    glBindVertexArray(coneVAO);
-    glDrawElements(GL_TRIANGLES, coneIndices.size(), GL_UNSIGNED_INT, 0);
-
-    // De-allocate resources
-    glDeleteVertexArrays(1, &coneVAO);
-    glDeleteBuffers(1, &coneVBO);
-    glDeleteBuffers(1, &coneEBO);
-}
\ No newline at end of file
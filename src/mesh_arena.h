@@ -0,0 +1,183 @@
+//
+//  mesh_arena.h
+//  3D Object Drawing
+//
+//  One VAO over the geometry buffer arena, shared by every cached mesh.
+//  Each mesh's vertices and indices are sub-allocated from the same GL
+//  buffer and addressed by base vertex and first index, so draws of
+//  different meshes never switch vertex state and can be merged into a
+//  single multi-draw. The vertex encoding is chosen once per arena: plain
+//  floats, or the compact form with half-float positions and texture
+//  coordinates and 10-10-10-2 normals at half the size.
+//
+
+#ifndef mesh_arena_h
+#define mesh_arena_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "buffer_arena.h"
+#include "vertex_format.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+enum VertexEncoding
+{
+    VERTEX_FLOAT,
+    VERTEX_COMPACT
+};
+
+// attribute locations of the arena's vertices; 2..6 are taken by the instance stream
+const GLuint POSITION_LOCATION = 0;
+const GLuint NORMAL_LOCATION = 1;  // what the shaders read as aNormal
+const GLuint TEXCOORD_LOCATION = 7;
+
+// 32 bytes
+struct FloatVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+// 16 bytes; see the packing helpers in vertex_format.h
+struct CompactVertex
+{
+    uint64_t position; // half x, y, z, 1
+    uint32_t normal;   // snorm 10-10-10-2
+    uint32_t texCoord; // half u, v
+};
+
+// where one mesh lives in the arena
+struct ArenaMesh
+{
+    unsigned int vertexAllocation = BufferArena::INVALID;
+    unsigned int indexAllocation = BufferArena::INVALID;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0; // in indices, not bytes
+};
+
+class MeshArena
+{
+public:
+    unsigned int VAO = 0;
+
+    // statistics
+    unsigned int glObjectsCreated = 0;
+
+    const VertexEncoding encoding;
+    const VertexLayout layout;
+
+    MeshArena(BufferArena& buffer, VertexEncoding encoding) : encoding(encoding), layout(layoutFor(encoding)), buffer(buffer)
+    {
+    }
+
+    static VertexLayout layoutFor(VertexEncoding encoding)
+    {
+        if (encoding == VERTEX_COMPACT)
+            return VertexLayout(sizeof(CompactVertex))
+                .add(POSITION_LOCATION, 4, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, position))
+                .add(NORMAL_LOCATION, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(CompactVertex, normal))
+                .add(TEXCOORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactVertex, texCoord));
+        return VertexLayout(sizeof(FloatVertex))
+            .add(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, position))
+            .add(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, normal))
+            .add(TEXCOORD_LOCATION, 2, GL_FLOAT, GL_FALSE, offsetof(FloatVertex, texCoord));
+    }
+
+    ~MeshArena()
+    {
+        release();
+    }
+
+    MeshArena(const MeshArena&) = delete;
+    MeshArena& operator=(const MeshArena&) = delete;
+
+    // copy one mesh into the arena; its indices stay relative to its own first vertex.
+    // Vertex ranges are aligned to the vertex size so their offset is a whole base vertex
+    bool append(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+                const std::vector<glm::vec2>& texCoords, const std::vector<unsigned int>& indices, ArenaMesh& mesh)
+    {
+        if (VAO == 0)
+            create();
+
+        std::vector<unsigned char> vertices(positions.size() * layout.stride);
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            unsigned char* vertex = &vertices[i * layout.stride];
+            if (encoding == VERTEX_COMPACT)
+            {
+                CompactVertex compact = {packPosition(positions[i]), packNormal(normals[i]), packTexCoord(texCoords[i])};
+                memcpy(vertex, &compact, sizeof(compact));
+            }
+            else
+            {
+                FloatVertex plain = {positions[i], normals[i], texCoords[i]};
+                memcpy(vertex, &plain, sizeof(plain));
+            }
+        }
+
+        mesh.vertexAllocation = buffer.allocate(vertices.size(), layout.stride);
+        mesh.indexAllocation = buffer.allocate(indices.size() * sizeof(GLuint), sizeof(GLuint));
+        if (mesh.vertexAllocation == BufferArena::INVALID || mesh.indexAllocation == BufferArena::INVALID)
+        {
+            free(mesh);
+            return false;
+        }
+        buffer.write(mesh.vertexAllocation, 0, vertices.size(), vertices.data());
+        buffer.write(mesh.indexAllocation, 0, indices.size() * sizeof(GLuint), indices.data());
+        relocate(mesh);
+        return true;
+    }
+
+    // refresh base vertex and first index after the buffer was defragmented
+    void relocate(ArenaMesh& mesh) const
+    {
+        if (mesh.vertexAllocation == BufferArena::INVALID)
+            return;
+        mesh.baseVertex = (GLint)(buffer.offset(mesh.vertexAllocation) / layout.stride);
+        mesh.firstIndex = (GLuint)(buffer.offset(mesh.indexAllocation) / sizeof(GLuint));
+    }
+
+    void free(ArenaMesh& mesh)
+    {
+        buffer.free(mesh.vertexAllocation);
+        buffer.free(mesh.indexAllocation);
+        mesh = ArenaMesh();
+    }
+
+    // free the VAO; the buffer belongs to the BufferArena. Needs a current GL context
+    void release()
+    {
+        if (VAO != 0)
+        {
+            glState.forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+            VAO = 0;
+        }
+    }
+
+private:
+    BufferArena& buffer;
+
+    void create()
+    {
+        glGenVertexArrays(1, &VAO);
+        glObjectsCreated++;
+
+        glState.bindVertexArray(VAO);
+        glState.bindBuffer(GL_ARRAY_BUFFER, buffer.buffer);
+        glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.buffer);
+
+        layout.apply();
+
+        glState.bindVertexArray(0);
+    }
+};
+
+#endif /* mesh_arena_h */
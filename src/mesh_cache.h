@@ -0,0 +1,371 @@
+//
+//  mesh_cache.h
+//  3D Object Drawing
+//
+//  Procedural primitive generators and a cache that uploads each
+//  (primitive, parameters) combination to the GPU exactly once, into the
+//  shared mesh arena.
+//
+
+#ifndef mesh_cache_h
+#define mesh_cache_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "bounds.h"
+#include "gl_state.h"
+#include "mesh_arena.h"
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cmath>
+
+enum PrimitiveType
+{
+    PRIMITIVE_CUBE,
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_CONE
+};
+
+// identifies one generated mesh; unused parameters stay zero
+struct MeshKey
+{
+    PrimitiveType type;
+    int segments;
+    int rings;
+    float height;
+    float radius;
+
+    bool operator==(const MeshKey& other) const
+    {
+        return type == other.type && segments == other.segments && rings == other.rings &&
+               height == other.height && radius == other.radius;
+    }
+};
+
+struct MeshKeyHash
+{
+    size_t operator()(const MeshKey& key) const
+    {
+        size_t h = std::hash<int>()(key.type);
+        h = h * 31 + std::hash<int>()(key.segments);
+        h = h * 31 + std::hash<int>()(key.rings);
+        h = h * 31 + std::hash<float>()(key.height);
+        h = h * 31 + std::hash<float>()(key.radius);
+        return h;
+    }
+};
+
+// CPU copy of a mesh's triangles, kept for picking and static batching; the
+// generators write it directly and the arena encodes it for the GPU
+struct MeshGeometry
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals; // unit length
+    std::vector<glm::vec2> texCoords;
+    std::vector<unsigned int> indices; // counter-clockwise seen from outside
+
+    void addVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoord)
+    {
+        positions.push_back(position);
+        normals.push_back(normal);
+        texCoords.push_back(texCoord);
+    }
+
+    void addTriangle(unsigned int a, unsigned int b, unsigned int c)
+    {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+};
+
+// GPU-resident mesh returned by the cache; every mesh lives in the same arena VAO
+struct MeshHandle
+{
+    unsigned int id = 0; // build order, unique per cache
+    unsigned int VAO = 0;
+    unsigned int indexCount = 0;
+    ArenaMesh placement; // base vertex and first index in the arena
+    Bounds bounds;       // local space, from the vertex positions
+};
+
+void generateCube(MeshGeometry& geometry);
+void generateCylinder(MeshGeometry& geometry, int segments, float height, float radius);
+void generateSphere(MeshGeometry& geometry, int segments, int rings, float radius);
+void generateCone(MeshGeometry& geometry, int segments, float height, float radius);
+
+class MeshCache
+{
+public:
+    // statistics
+    unsigned int meshesBuilt = 0;           // meshes uploaded since startup
+    unsigned int glObjectsCreated = 0;      // VAOs + buffers created since startup
+    unsigned int frameGLObjectsCreated = 0; // VAOs + buffers created since beginFrame()
+    unsigned int lookups = 0;
+    unsigned int misses = 0;
+    size_t vertexBytes = 0; // GPU vertex data of every mesh built
+
+    MeshArena arena;
+
+    // meshes are sub-allocated from the given buffer arena in the given vertex encoding
+    MeshCache(BufferArena& buffer, VertexEncoding encoding) : arena(buffer, encoding), buffer(buffer)
+    {
+    }
+
+    ~MeshCache()
+    {
+        release();
+    }
+
+    MeshHandle getCube()
+    {
+        return get({ PRIMITIVE_CUBE, 0, 0, 0.0f, 0.0f });
+    }
+    MeshHandle getCylinder(int segments, float height, float radius)
+    {
+        return get({ PRIMITIVE_CYLINDER, segments, 0, height, radius });
+    }
+    MeshHandle getSphere(int segments, int rings, float radius)
+    {
+        return get({ PRIMITIVE_SPHERE, segments, rings, 0.0f, radius });
+    }
+    MeshHandle getCone(int segments, float height, float radius)
+    {
+        return get({ PRIMITIVE_CONE, segments, 0, height, radius });
+    }
+
+    // triangles of a mesh returned by this cache, or NULL
+    const MeshGeometry* getGeometry(const MeshHandle& mesh) const
+    {
+        auto it = geometries.find(mesh.id);
+        return it != geometries.end() ? &it->second : NULL;
+    }
+
+    // refresh a handle's placement after the buffer arena was defragmented
+    void relocate(MeshHandle& mesh) const
+    {
+        arena.relocate(mesh.placement);
+    }
+
+    // start counting GL allocations for a new frame
+    void beginFrame()
+    {
+        frameGLObjectsCreated = 0;
+    }
+
+    // free every cached mesh; needs a current GL context
+    void release()
+    {
+        for (auto& entry : meshes)
+            arena.free(entry.second.placement);
+        arena.release();
+        meshes.clear();
+        geometries.clear();
+    }
+
+private:
+    BufferArena& buffer;
+    unsigned int bufferVersion = 0; // arena version the cached placements belong to
+    std::unordered_map<MeshKey, MeshHandle, MeshKeyHash> meshes;
+    std::unordered_map<unsigned int, MeshGeometry> geometries; // by mesh id
+
+    MeshHandle get(const MeshKey& key)
+    {
+        lookups++;
+        if (bufferVersion != buffer.version)
+        {
+            for (auto& entry : meshes)
+                relocate(entry.second);
+            bufferVersion = buffer.version;
+        }
+        auto it = meshes.find(key);
+        if (it != meshes.end())
+            return it->second;
+
+        misses++;
+        MeshHandle mesh = build(key);
+        meshes.emplace(key, mesh);
+        return mesh;
+    }
+
+    MeshHandle build(const MeshKey& key)
+    {
+        MeshHandle mesh;
+        mesh.id = meshesBuilt++;
+        MeshGeometry& geometry = geometries[mesh.id];
+
+        switch (key.type)
+        {
+        case PRIMITIVE_CUBE:
+            generateCube(geometry);
+            break;
+        case PRIMITIVE_CYLINDER:
+            generateCylinder(geometry, key.segments, key.height, key.radius);
+            break;
+        case PRIMITIVE_SPHERE:
+            generateSphere(geometry, key.segments, key.rings, key.radius);
+            break;
+        case PRIMITIVE_CONE:
+            generateCone(geometry, key.segments, key.height, key.radius);
+            break;
+        }
+
+        mesh.indexCount = (unsigned int)geometry.indices.size();
+        mesh.bounds = geometry.positions.empty() ? Bounds() : computeBounds(&geometry.positions[0].x, geometry.positions.size(), 3);
+        vertexBytes += geometry.positions.size() * arena.layout.stride;
+
+        unsigned int objectsBefore = arena.glObjectsCreated;
+        if (!arena.append(geometry.positions, geometry.normals, geometry.texCoords, geometry.indices, mesh.placement))
+            mesh.indexCount = 0;
+        mesh.VAO = arena.VAO;
+        glObjectsCreated += arena.glObjectsCreated - objectsBefore;
+        frameGLObjectsCreated += arena.glObjectsCreated - objectsBefore;
+        return mesh;
+    }
+};
+
+// 0.5 unit cube from the origin; four vertices per face so each face has its own normal
+inline void generateCube(MeshGeometry& geometry)
+{
+    const glm::vec3 faceNormals[6] = {
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+    const glm::vec2 corners[4] = {
+        glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(1.0f, 1.0f), glm::vec2(-1.0f, 1.0f) };
+
+    for (const glm::vec3& normal : faceNormals)
+    {
+        // u x v = normal, so the corners run counter-clockwise seen from outside
+        glm::vec3 u = std::abs(normal.y) > 0.5f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 v = glm::cross(normal, u);
+        glm::vec3 center = glm::vec3(0.25f) + 0.25f * normal;
+
+        unsigned int first = (unsigned int)geometry.positions.size();
+        for (const glm::vec2& corner : corners)
+            geometry.addVertex(center + 0.25f * (corner.x * u + corner.y * v), normal, 0.5f * (corner + 1.0f));
+        geometry.addTriangle(first, first + 1, first + 2);
+        geometry.addTriangle(first + 2, first + 3, first);
+    }
+}
+
+// centered on the origin along y; flat caps, and smooth sides with a seam column for the texture
+inline void generateCylinder(MeshGeometry& geometry, int segments, float height, float radius)
+{
+    float top = height / 2.0f;
+    float bottom = -height / 2.0f;
+
+    // caps: a center vertex and a rim, facing up and down
+    for (int cap = 0; cap < 2; cap++)
+    {
+        float y = cap == 0 ? top : bottom;
+        glm::vec3 normal(0.0f, cap == 0 ? 1.0f : -1.0f, 0.0f);
+        unsigned int center = (unsigned int)geometry.positions.size();
+        geometry.addVertex(glm::vec3(0.0f, y, 0.0f), normal, glm::vec2(0.5f));
+        for (int i = 0; i <= segments; i++)
+        {
+            float angle = 2.0f * glm::pi<float>() * i / segments;
+            glm::vec2 direction(cos(angle), sin(angle));
+            geometry.addVertex(glm::vec3(radius * direction.x, y, radius * direction.y), normal, 0.5f + 0.5f * direction);
+        }
+        for (int i = 0; i < segments; i++)
+        {
+            unsigned int rim = center + 1 + i;
+            if (cap == 0)
+                geometry.addTriangle(center, rim + 1, rim);
+            else
+                geometry.addTriangle(center, rim, rim + 1);
+        }
+    }
+
+    // sides: a top and a bottom vertex per column, both with the radial normal
+    unsigned int side = (unsigned int)geometry.positions.size();
+    for (int i = 0; i <= segments; i++)
+    {
+        float angle = 2.0f * glm::pi<float>() * i / segments;
+        glm::vec3 normal(cos(angle), 0.0f, sin(angle));
+        float u = (float)i / segments;
+        geometry.addVertex(glm::vec3(radius * normal.x, top, radius * normal.z), normal, glm::vec2(u, 1.0f));
+        geometry.addVertex(glm::vec3(radius * normal.x, bottom, radius * normal.z), normal, glm::vec2(u, 0.0f));
+    }
+    for (int i = 0; i < segments; i++)
+    {
+        unsigned int top1 = side + 2 * i;
+        unsigned int bottom1 = top1 + 1;
+        unsigned int top2 = top1 + 2;
+        unsigned int bottom2 = top1 + 3;
+        geometry.addTriangle(top1, top2, bottom1);
+        geometry.addTriangle(bottom1, top2, bottom2);
+    }
+}
+
+// UV sphere around the origin; the normal is the direction from the center
+inline void generateSphere(MeshGeometry& geometry, int segments, int rings, float radius)
+{
+    for (int i = 0; i <= rings; ++i)
+    {
+        float theta = i * glm::pi<float>() / rings;
+        float sinTheta = sin(theta);
+        float cosTheta = cos(theta);
+
+        for (int j = 0; j <= segments; ++j)
+        {
+            float phi = j * 2 * glm::pi<float>() / segments;
+            glm::vec3 normal(cos(phi) * sinTheta, cosTheta, sin(phi) * sinTheta);
+            glm::vec2 texCoord(1 - (float)j / segments, 1 - (float)i / rings);
+            geometry.addVertex(radius * normal, normal, texCoord);
+        }
+    }
+
+    for (int i = 0; i < rings; ++i)
+    {
+        for (int j = 0; j < segments; ++j)
+        {
+            unsigned int first = (i * (segments + 1)) + j;
+            unsigned int second = first + segments + 1;
+            geometry.addTriangle(first, first + 1, second);
+            geometry.addTriangle(second, first + 1, second + 1);
+        }
+    }
+}
+
+// base on y = 0 facing down, apex at height; the sides get one apex vertex per
+// segment so each slanted face points its own way at the tip
+inline void generateCone(MeshGeometry& geometry, int segments, float height, float radius)
+{
+    glm::vec3 down(0.0f, -1.0f, 0.0f);
+    unsigned int center = (unsigned int)geometry.positions.size();
+    geometry.addVertex(glm::vec3(0.0f), down, glm::vec2(0.5f));
+    for (int i = 0; i <= segments; ++i)
+    {
+        float theta = i * 2.0f * glm::pi<float>() / segments;
+        glm::vec2 direction(cos(theta), sin(theta));
+        geometry.addVertex(glm::vec3(radius * direction.x, 0.0f, radius * direction.y), down, 0.5f + 0.5f * direction);
+    }
+    for (int i = 0; i < segments; ++i)
+        geometry.addTriangle(center, center + 1 + i, center + 2 + i);
+
+    // the side normal tilts up by the slope: (height * radial, radius) normalized
+    auto sideNormal = [&](float theta)
+    {
+        return glm::normalize(glm::vec3(height * cos(theta), radius, height * sin(theta)));
+    };
+    for (int i = 0; i < segments; ++i)
+    {
+        float theta1 = i * 2.0f * glm::pi<float>() / segments;
+        float theta2 = (i + 1) * 2.0f * glm::pi<float>() / segments;
+        float u1 = (float)i / segments;
+        float u2 = (float)(i + 1) / segments;
+        unsigned int first = (unsigned int)geometry.positions.size();
+        geometry.addVertex(glm::vec3(radius * cos(theta1), 0.0f, radius * sin(theta1)), sideNormal(theta1), glm::vec2(u1, 0.0f));
+        geometry.addVertex(glm::vec3(0.0f, height, 0.0f), sideNormal(0.5f * (theta1 + theta2)), glm::vec2(0.5f * (u1 + u2), 1.0f));
+        geometry.addVertex(glm::vec3(radius * cos(theta2), 0.0f, radius * sin(theta2)), sideNormal(theta2), glm::vec2(u2, 0.0f));
+        geometry.addTriangle(first, first + 1, first + 2);
+    }
+}
+
+#endif /* mesh_cache_h */
@@ -0,0 +1,145 @@
+//
+//  multi_draw.h
+//  3D Object Drawing
+//
+//  Per-frame list of indexed draw commands over the mesh arena. The list is
+//  written on the CPU once per frame; with ARB_multi_draw_indirect (plus
+//  base instance) a whole run of commands goes to the driver as one
+//  glMultiDrawElementsIndirect call. On plain GL 3.3 there is no base
+//  instance or draw id, so per-command instance data can't reach a
+//  glMultiDrawElementsBaseVertex; the same commands are walked instead, one
+//  glDrawElementsInstancedBaseVertex each with the instance stream rebased.
+//  The commands live in a StreamBuffer, like the instance stream.
+//
+
+#ifndef multi_draw_h
+#define multi_draw_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "buffer_arena.h"
+#include "stream_buffer.h"
+#include "instanced_renderer.h"
+
+#include <vector>
+#include <memory>
+#include <iostream>
+
+// layout fixed by the GL spec for indirect indexed draws
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class MultiDrawBuffer
+{
+public:
+    bool indirect = false; // glMultiDrawElementsIndirect in use
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    // statistics since the last clear()
+    unsigned int drawCalls = 0;
+    unsigned int commandsDrawn = 0;
+
+    // instances: the stream the commands' base instances index into
+    MultiDrawBuffer(InstancedRenderer& instances, BufferArena& buffer, unsigned int maxCommands, bool allowIndirect)
+        : instances(instances), capacity(maxCommands)
+    {
+        commands.reserve(capacity);
+        indirect = allowIndirect && glExtensions.multiDrawIndirect;
+        if (indirect)
+            stream.reset(new StreamBuffer(buffer, capacity * sizeof(DrawElementsIndirectCommand), sizeof(GLuint)));
+    }
+
+    ~MultiDrawBuffer()
+    {
+        release();
+    }
+
+    MultiDrawBuffer(const MultiDrawBuffer&) = delete;
+    MultiDrawBuffer& operator=(const MultiDrawBuffer&) = delete;
+
+    // start the next frame's commands, in the next region
+    void clear()
+    {
+        commands.clear();
+        if (stream)
+            stream->beginFrame();
+        drawCalls = 0;
+        commandsDrawn = 0;
+    }
+
+    // index of the new command, or -1 when the frame is full
+    int add(const DrawElementsIndirectCommand& command)
+    {
+        if (commands.size() >= capacity)
+        {
+            std::cout << "WARNING::MULTI_DRAW: more than " << capacity << " commands, dropping" << std::endl;
+            return -1;
+        }
+        commands.push_back(command);
+        return (int)commands.size() - 1;
+    }
+
+    // hand the frame's commands to the GPU; call once, after the last add()
+    void upload()
+    {
+        if (!indirect || commands.empty())
+            return;
+        stream->write(commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+    }
+
+    // fence the frame's region once every draw that reads it has been submitted
+    void end()
+    {
+        if (stream)
+            stream->endFrame();
+    }
+
+    // draw commands [first, first + count); the program and arena VAO must be bound.
+    // Returns the number of GL draw calls it took
+    unsigned int draw(size_t first, size_t count)
+    {
+        if (count == 0)
+            return 0;
+        commandsDrawn += (unsigned int)count;
+        if (indirect)
+        {
+            GLintptr offset = stream->regionStart() + first * sizeof(DrawElementsIndirectCommand);
+            glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream->buffer());
+            glExtensions.MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, (GLsizei)count, 0);
+            drawCalls++;
+            return 1;
+        }
+
+        for (size_t i = first; i < first + count; i++)
+        {
+            const DrawElementsIndirectCommand& command = commands[i];
+            instances.setBaseInstance(command.baseInstance);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (void*)(command.firstIndex * sizeof(GLuint)),
+                                              command.instanceCount, command.baseVertex);
+            drawCalls++;
+        }
+        return (unsigned int)count;
+    }
+
+    // free the command stream's fences and storage; needs a current GL context
+    void release()
+    {
+        if (stream)
+            stream->release();
+    }
+
+private:
+    InstancedRenderer& instances;
+    unsigned int capacity;
+    std::unique_ptr<StreamBuffer> stream; // only with indirect draws
+};
+
+#endif /* multi_draw_h */
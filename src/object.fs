@@ -0,0 +1,34 @@
+#version 330 core
+// Fragment shader of every object variant; see object.vs and lighting.glsl for the defines
+out vec4 FragColor;
+
+uniform vec3 objectColor;
+
+#if SHADING_GOURAUD
+in vec3 LightingColor;
+
+void main()
+{
+    FragColor = vec4(clamp(LightingColor * objectColor, 0.0, 1.0), 1.0);
+}
+#else
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform vec3 viewPos;
+
+#include "lighting.glsl"
+
+void main()
+{
+    vec3 N = normalize(Normal);
+    vec3 V = normalize(viewPos - FragPos);
+    vec3 result = CalcLighting(FragPos, N, V);
+
+    // Final color (apply object color)
+    result *= objectColor;
+
+    // Clamp the final result to ensure no values above 1.0
+    FragColor = vec4(clamp(result, 0.0, 1.0), 1.0);
+}
+#endif
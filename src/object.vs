@@ -0,0 +1,64 @@
+#version 330 core
+// Vertex shader of every object variant:
+//   INSTANCED: model, normal matrix and color come per instance; otherwise the model and
+//              normal matrix come from ObjectBlock and the color per vertex (static batch)
+//   NORMAL_MATRIX_FROM_MODEL: invert the model per vertex instead of using the uploaded
+//              normal matrix; only for comparison
+//   SHADING_GOURAUD: light per vertex and hand the fragment shader a color
+layout (location = 0) in vec3 aPos;  // Position variable has attribute position 0
+layout (location = 1) in vec3 aNormal; // Normal variable has attribute position 1
+#if INSTANCED
+layout (location = 2) in vec4 aColor; // Per-instance color
+layout (location = 3) in mat4 aModel; // Per-instance model matrix, occupies locations 3 to 6
+layout (location = 8) in mat3 aNormalMatrix; // Per-instance inverse transpose of the model, locations 8 to 10
+#else
+layout (location = 2) in vec4 aColor; // Per-vertex object color, baked with the geometry
+
+// per-draw data; model is the batch root's world matrix, color tints the whole batch
+layout (std140) uniform ObjectBlock
+{
+    mat4 model;
+    vec4 color;
+    mat3 normalMatrix; // inverse transpose of model, computed on the CPU
+};
+#endif
+
+#if SHADING_GOURAUD
+out vec3 LightingColor; // Lit color, interpolated across the triangle
+uniform vec3 viewPos;
+#include "lighting.glsl"
+#else
+out vec3 FragPos; // Will hold the fragment position in world space
+out vec3 Normal;  // Will hold the normal in world space
+#endif
+out vec4 VertexColor; // Object color for fragment shaders that use it
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+#if INSTANCED
+    mat4 objectModel = aModel;
+    mat3 objectNormalMatrix = aNormalMatrix;
+    VertexColor = aColor;
+#else
+    mat4 objectModel = model;
+    mat3 objectNormalMatrix = normalMatrix;
+    VertexColor = aColor * color;
+#endif
+#if NORMAL_MATRIX_FROM_MODEL
+    objectNormalMatrix = mat3(transpose(inverse(objectModel)));
+#endif
+
+    vec3 worldPos = vec3(objectModel * vec4(aPos, 1.0)); // Transform the vertex position to world space
+    vec3 worldNormal = objectNormalMatrix * aNormal; // Transform the normal to world space
+    gl_Position = projection * view * vec4(worldPos, 1.0); // Final position in clip space
+
+#if SHADING_GOURAUD
+    LightingColor = CalcLighting(worldPos, normalize(worldNormal), normalize(viewPos - worldPos));
+#else
+    FragPos = worldPos;
+    Normal = worldNormal;
+#endif
+}
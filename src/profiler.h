@@ -0,0 +1,325 @@
+//
+//  profiler.h
+//  3D Object Drawing
+//
+//  Frame profiler: named, nestable scopes timed on the CPU with
+//  steady_clock and on the GPU with GL_TIMESTAMP queries. Query results
+//  are only read once the driver reports them available, a few frames
+//  later, so the profiler never stalls the pipeline. Averages over a
+//  rolling window are printed to the console, and every resolved frame can
+//  be exported as a Chrome trace (chrome://tracing, Perfetto).
+//
+
+#ifndef profiler_h
+#define profiler_h
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+class Profiler
+{
+public:
+    bool enabled = false;
+    unsigned int reportInterval = 120; // resolved frames per console breakdown; 0 disables it
+    unsigned int maxFramesInFlight = 8; // older unresolved frames are dropped, never waited on
+    unsigned int maxTraceFrames = 3600; // frames kept for writeChromeTrace()
+
+    // statistics
+    unsigned int framesResolved = 0;
+    unsigned int framesDropped = 0;
+
+    Profiler()
+    {
+        origin = std::chrono::steady_clock::now();
+    }
+
+    ~Profiler()
+    {
+        release();
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void beginFrame()
+    {
+        if (!enabled)
+            return;
+        collect();
+        current.index = frameIndex++;
+        current.events.clear();
+        depth = 0;
+    }
+
+    void endFrame()
+    {
+        if (!enabled)
+            return;
+        inFlight.push_back(current);
+        current.events.clear();
+        if (inFlight.size() > maxFramesInFlight)
+        {
+            // the GPU is far behind; dropping keeps the profiler from ever blocking
+            for (const ProfileEvent& event : inFlight.front().events)
+            {
+                freeQueries.push_back(event.startQuery);
+                freeQueries.push_back(event.endQuery);
+            }
+            inFlight.pop_front();
+            framesDropped++;
+        }
+    }
+
+    // open a scope; name must outlive the profiler (string literals)
+    int begin(const char* name)
+    {
+        if (!enabled)
+            return -1;
+        ProfileEvent event;
+        event.name = name;
+        event.depth = depth++;
+        event.startQuery = allocateQuery();
+        event.endQuery = allocateQuery();
+        glQueryCounter(event.startQuery, GL_TIMESTAMP);
+        event.cpuStartMs = nowMs();
+        current.events.push_back(event);
+        return (int)current.events.size() - 1;
+    }
+
+    void end(int scope)
+    {
+        if (scope < 0)
+            return;
+        ProfileEvent& event = current.events[scope];
+        event.cpuEndMs = nowMs();
+        glQueryCounter(event.endQuery, GL_TIMESTAMP);
+        depth--;
+    }
+
+    // print the average of every scope over the frames resolved since the last call
+    void printBreakdown()
+    {
+        if (window.empty() || windowFrames == 0)
+            return;
+        std::cout << "Profiler: average over " << windowFrames << " frames (ms)" << std::endl;
+        std::cout << "  " << std::left << std::setw(28) << "scope" << std::right << std::setw(10) << "cpu" << std::setw(10) << "gpu" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        for (const ScopeTotals& totals : window)
+        {
+            std::string label = std::string(2 * totals.depth, ' ') + totals.name;
+            std::cout << "  " << std::left << std::setw(28) << label << std::right
+                      << std::setw(10) << totals.cpuMs / windowFrames
+                      << std::setw(10) << totals.gpuMs / windowFrames << std::endl;
+        }
+        std::cout << std::defaultfloat << std::setprecision(6);
+        window.clear();
+        windowFrames = 0;
+    }
+
+    // one thread for CPU scopes, one for GPU scopes; GPU times are placed
+    // relative to the CPU start of the frame's first scope
+    bool writeChromeTrace(const char* path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER: cannot write " << path << std::endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        file << std::fixed << std::setprecision(3);
+        for (const ProfileFrame& frame : trace)
+        {
+            if (frame.events.empty())
+                continue;
+            double gpuOffsetMs = frame.events[0].cpuStartMs - frame.events[0].gpuStartMs;
+            for (const ProfileEvent& event : frame.events)
+            {
+                writeTraceEvent(file, event.name, 1, event.cpuStartMs, event.cpuEndMs - event.cpuStartMs, frame.index);
+                writeTraceEvent(file, event.name, 2, event.gpuStartMs + gpuOffsetMs, event.gpuEndMs - event.gpuStartMs, frame.index);
+            }
+        }
+        file << "\n]}\n";
+        return true;
+    }
+
+    // resolve everything still in flight, waiting if needed; for shutdown only
+    void finish()
+    {
+        if (!enabled)
+            return;
+        glFinish();
+        collect();
+    }
+
+    // free every query object; needs a current GL context
+    void release()
+    {
+        for (const ProfileFrame& frame : inFlight)
+        {
+            for (const ProfileEvent& event : frame.events)
+            {
+                freeQueries.push_back(event.startQuery);
+                freeQueries.push_back(event.endQuery);
+            }
+        }
+        inFlight.clear();
+        if (!freeQueries.empty())
+        {
+            glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+            freeQueries.clear();
+        }
+    }
+
+private:
+    struct ProfileEvent
+    {
+        const char* name;
+        int depth;
+        GLuint startQuery, endQuery;
+        double cpuStartMs, cpuEndMs;
+        double gpuStartMs, gpuEndMs;
+    };
+
+    struct ProfileFrame
+    {
+        unsigned int index = 0;
+        std::vector<ProfileEvent> events;
+    };
+
+    struct ScopeTotals
+    {
+        const char* name;
+        int depth;
+        double cpuMs;
+        double gpuMs;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    unsigned int frameIndex = 0;
+    int depth = 0;
+    ProfileFrame current;
+    std::deque<ProfileFrame> inFlight;
+    std::vector<GLuint> freeQueries;
+    std::vector<ProfileFrame> trace;
+    std::vector<ScopeTotals> window;
+    unsigned int windowFrames = 0;
+
+    double nowMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    GLuint allocateQuery()
+    {
+        if (freeQueries.empty())
+        {
+            GLuint queries[16];
+            glGenQueries(16, queries);
+            freeQueries.insert(freeQueries.end(), queries, queries + 16);
+        }
+        GLuint query = freeQueries.back();
+        freeQueries.pop_back();
+        return query;
+    }
+
+    // read back every in-flight frame whose last query is available, oldest first
+    void collect()
+    {
+        while (!inFlight.empty())
+        {
+            ProfileFrame& frame = inFlight.front();
+            if (!frame.events.empty())
+            {
+                // queries complete in order, so the frame's last one decides
+                GLint available = 0;
+                glGetQueryObjectiv(frame.events.back().endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+            }
+
+            for (ProfileEvent& event : frame.events)
+            {
+                GLuint64 start = 0, end = 0;
+                glGetQueryObjectui64v(event.startQuery, GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(event.endQuery, GL_QUERY_RESULT, &end);
+                event.gpuStartMs = start / 1.0e6;
+                event.gpuEndMs = end / 1.0e6;
+                freeQueries.push_back(event.startQuery);
+                freeQueries.push_back(event.endQuery);
+                accumulate(event);
+            }
+            windowFrames++;
+            framesResolved++;
+            if (trace.size() < maxTraceFrames)
+                trace.push_back(frame);
+            inFlight.pop_front();
+
+            if (reportInterval > 0 && windowFrames >= reportInterval)
+                printBreakdown();
+        }
+    }
+
+    void accumulate(const ProfileEvent& event)
+    {
+        ScopeTotals* totals = NULL;
+        for (ScopeTotals& entry : window)
+        {
+            if (entry.depth == event.depth && std::strcmp(entry.name, event.name) == 0)
+            {
+                totals = &entry;
+                break;
+            }
+        }
+        if (totals == NULL)
+        {
+            window.push_back({event.name, event.depth, 0.0, 0.0});
+            totals = &window.back();
+        }
+        totals->cpuMs += event.cpuEndMs - event.cpuStartMs;
+        totals->gpuMs += event.gpuEndMs - event.gpuStartMs;
+    }
+
+    static void writeTraceEvent(std::ofstream& file, const char* name, int thread, double startMs, double durationMs, unsigned int frame)
+    {
+        // Chrome trace times are microseconds
+        file << ",\n{\"name\":\"" << name << "\",\"cat\":\"" << (thread == 1 ? "cpu" : "gpu")
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+             << ",\"ts\":" << startMs * 1000.0 << ",\"dur\":" << durationMs * 1000.0
+             << ",\"args\":{\"frame\":" << frame << "}}";
+    }
+};
+
+// times the enclosing block as one profiler scope
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler& profiler, const char* name) : profiler(profiler)
+    {
+        scope = profiler.begin(name);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.end(scope);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler& profiler;
+    int scope;
+};
+
+#endif /* profiler_h */
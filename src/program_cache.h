@@ -0,0 +1,173 @@
+//
+//  program_cache.h
+//  3D Object Drawing
+//
+//  On-disk cache of linked program binaries (ARB_get_program_binary). A
+//  program is stored under a 64-bit hash of its shader sources, its
+//  defines and the driver's vendor, renderer and version strings, so a new
+//  driver or an edited shader simply misses. A warm start loads the blob
+//  with glProgramBinary and skips compiling and linking; a blob the driver
+//  rejects is deleted and the program is compiled from source again.
+//
+
+#ifndef program_cache_h
+#define program_cache_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+
+class ProgramCache
+{
+public:
+    bool enabled = false; // false without driver support or without a usable directory
+
+    // statistics
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    unsigned int rejects = 0; // blobs found on disk that the driver refused
+    unsigned int stores = 0;
+
+    // needs a current GL context with the extensions loaded
+    void open(const std::string& cacheDirectory)
+    {
+        directory = cacheDirectory;
+        enabled = false;
+        if (!glExtensions.programBinary)
+            return;
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (error)
+        {
+            std::cout << "WARNING::PROGRAM_CACHE: can't create " << directory << ": " << error.message() << std::endl;
+            return;
+        }
+
+        driver = 14695981039346656037ull;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char* value = (const char*)glGetString(name);
+            driver = hash(value ? value : "", driver);
+        }
+        enabled = true;
+    }
+
+    // key of one program; sources are hashed in order, with a separator so
+    // moving text from one stage to the next changes the key
+    uint64_t key(const std::vector<std::string>& sources, const std::string& defines) const
+    {
+        uint64_t result = hash(defines, driver);
+        for (const std::string& source : sources)
+            result = hash(source, hash("\n--\n", result));
+        return result;
+    }
+
+    // set before linking a program that store() should be able to read back
+    void prepare(GLuint program) const
+    {
+        if (enabled)
+            glExtensions.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // load a cached binary into program; false if there is none or it no longer links
+    bool load(uint64_t programKey, GLuint program)
+    {
+        if (!enabled)
+            return false;
+
+        std::ifstream file(path(programKey), std::ios::binary);
+        uint32_t header[3] = {0, 0, 0}; // magic, format, length
+        if (!file || !file.read((char*)header, sizeof(header)) || header[0] != MAGIC)
+        {
+            misses++;
+            return false;
+        }
+        std::vector<char> binary(header[2]);
+        if (!file.read(binary.data(), binary.size()))
+        {
+            misses++;
+            return false;
+        }
+        file.close();
+
+        glExtensions.ProgramBinary(program, (GLenum)header[1], binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            rejects++;
+            std::remove(path(programKey).c_str());
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    // write a linked program's binary
+    void store(uint64_t programKey, GLuint program)
+    {
+        if (!enabled)
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glExtensions.GetProgramBinary(program, length, &length, &format, binary.data());
+
+        // written under a temporary name so a crash never leaves half a blob behind
+        std::string target = path(programKey);
+        std::string temporary = target + ".tmp";
+        std::ofstream file(temporary, std::ios::binary);
+        uint32_t header[3] = {MAGIC, (uint32_t)format, (uint32_t)length};
+        file.write((const char*)header, sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+        std::error_code error;
+        if (file)
+            std::filesystem::rename(temporary, target, error);
+        if (!file || error)
+        {
+            std::remove(temporary.c_str());
+            return;
+        }
+        stores++;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x31424750; // "PGB1"
+
+    std::string directory;
+    uint64_t driver = 0;
+
+    // FNV-1a, continued from seed
+    static uint64_t hash(const std::string& text, uint64_t seed)
+    {
+        uint64_t result = seed;
+        for (unsigned char c : text)
+        {
+            result ^= c;
+            result *= 1099511628211ull;
+        }
+        return result;
+    }
+
+    std::string path(uint64_t programKey) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)programKey);
+        return (std::filesystem::path(directory) / name).string();
+    }
+};
+
+#endif /* program_cache_h */
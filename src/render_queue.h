@@ -0,0 +1,260 @@
+//
+//  render_queue.h
+//  3D Object Drawing
+//
+//  Draw items tagged with a 64-bit sort key (pass, program, mesh, material,
+//  depth). The queue is radix sorted once per frame and submitted in key
+//  order, so consecutive items share programs and vertex arrays (the GL
+//  state cache drops the repeated binds), and opaque draws go out front to
+//  back for early-Z. Runs of instanced items on the same program and vertex
+//  array are turned into one multi-draw when a MultiDrawBuffer is attached.
+//  With a FrameArena attached, the per-frame lists are taken from it.
+//
+
+#ifndef render_queue_h
+#define render_queue_h
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "uniform_ring.h"
+#include "multi_draw.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// one draw; instanceCount 0 is a plain glDrawElements, objectOffset < 0 binds no ObjectBlock.
+// firstIndex/baseVertex address a mesh inside a shared arena, baseInstance the
+// mesh's run in the instance stream (honored only through a MultiDrawBuffer)
+struct RenderItem
+{
+    uint64_t key;
+    GLuint program;
+    GLuint VAO;
+    GLsizei indexCount;
+    GLsizei instanceCount;
+    GLintptr objectOffset;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class RenderQueue
+{
+public:
+    // key fields, most significant first; ids must fit their field
+    static const int PASS_BITS = 4;
+    static const int PROGRAM_BITS = 8;
+    static const int MESH_BITS = 12;
+    static const int MATERIAL_BITS = 16;
+    static const int DEPTH_BITS = 24;
+
+    static const int DEPTH_SHIFT = 0;
+    static const int MATERIAL_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+    static const int MESH_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+    static const int PROGRAM_SHIFT = MESH_SHIFT + MESH_BITS;
+    static const int PASS_SHIFT = PROGRAM_SHIFT + PROGRAM_BITS;
+
+    FrameVector<RenderItem> items;
+
+    // where sort() writes the frame's instanced draws; NULL draws them one by one
+    MultiDrawBuffer* multiDraw = NULL;
+
+    // backs the lists from clear() on; the arena must be reset before clear()
+    FrameArena* arena = NULL;
+
+    // statistics since the last clear()
+    unsigned int drawCalls = 0;
+
+    // depth is the normalized view distance, 0 at the eye; smaller sorts first,
+    // so a back-to-front pass would pass 1 - depth
+    static uint64_t makeKey(unsigned int pass, unsigned int program, unsigned int mesh, unsigned int material, float depth)
+    {
+        const uint64_t depthMax = (1ull << DEPTH_BITS) - 1;
+        uint64_t quantized = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+        return field(pass, PASS_BITS) << PASS_SHIFT |
+               field(program, PROGRAM_BITS) << PROGRAM_SHIFT |
+               field(mesh, MESH_BITS) << MESH_SHIFT |
+               field(material, MATERIAL_BITS) << MATERIAL_SHIFT |
+               quantized << DEPTH_SHIFT;
+    }
+
+    // start a new frame; expectedItems is reserved up front
+    void clear(size_t expectedItems = 0)
+    {
+        if (arena != NULL)
+        {
+            items = FrameVector<RenderItem>(*arena);
+            sorted = FrameVector<SortEntry>(*arena);
+            scratch = FrameVector<SortEntry>(*arena);
+            runs = FrameVector<int>(*arena);
+            drawRuns = FrameVector<DrawRun>(*arena);
+        }
+        items.clear();
+        sorted.clear();
+        runs.clear();
+        drawRuns.clear();
+        items.reserve(expectedItems);
+        drawCalls = 0;
+    }
+
+    void add(const RenderItem& item)
+    {
+        items.push_back(item);
+    }
+
+    // LSD radix sort of the keys, one byte per pass; a byte every key shares is skipped,
+    // which with few passes and programs removes most of the high passes
+    void sort()
+    {
+        size_t count = items.size();
+        sorted.resize(count);
+        scratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+            sorted[i] = {items[i].key, (unsigned int)i};
+
+        for (int shift = 0; count > 1 && shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (const SortEntry& entry : sorted)
+                offsets[(entry.key >> shift) & 0xFF]++;
+            if (offsets[(sorted[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            size_t total = 0;
+            for (size_t& offset : offsets)
+            {
+                size_t bucket = offset;
+                offset = total;
+                total += bucket;
+            }
+            for (const SortEntry& entry : sorted)
+                scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            sorted.swap(scratch);
+        }
+
+        if (multiDraw != NULL)
+            buildCommands();
+    }
+
+    // draw every sorted item
+    void submit(const UniformRing& objectRing)
+    {
+        submitRange(objectRing, 0, sorted.size());
+    }
+
+    // draw the sorted items of one pass
+    void submitPass(const UniformRing& objectRing, unsigned int pass)
+    {
+        auto first = std::lower_bound(sorted.begin(), sorted.end(), pass, [](const SortEntry& entry, unsigned int value)
+                                      { return passOf(entry.key) < value; });
+        auto last = std::upper_bound(first, sorted.end(), pass, [](unsigned int value, const SortEntry& entry)
+                                     { return value < passOf(entry.key); });
+        submitRange(objectRing, first - sorted.begin(), last - sorted.begin());
+    }
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        unsigned int item;
+    };
+
+    // consecutive sorted items [start, end) drawn as commands [firstCommand, firstCommand + commandCount)
+    struct DrawRun
+    {
+        size_t end;
+        size_t firstCommand;
+        size_t commandCount;
+    };
+
+    FrameVector<SortEntry> sorted;
+    FrameVector<SortEntry> scratch;
+    FrameVector<int> runs; // per sorted position, the DrawRun starting there or -1
+    FrameVector<DrawRun> drawRuns;
+
+    static uint64_t field(unsigned int value, int bits)
+    {
+        return (uint64_t)value & ((1ull << bits) - 1);
+    }
+
+    static unsigned int passOf(uint64_t key)
+    {
+        return (unsigned int)(key >> PASS_SHIFT);
+    }
+
+    // instanced items without an ObjectBlock can share a draw when the pass, program
+    // and vertex array match; a run never spans passes, so submitPass can't split one
+    static bool canMerge(const RenderItem& a, const RenderItem& b)
+    {
+        return passOf(a.key) == passOf(b.key) && a.program == b.program && a.VAO == b.VAO;
+    }
+
+    static bool isMultiDrawable(const RenderItem& item)
+    {
+        return item.instanceCount > 0 && item.objectOffset < 0;
+    }
+
+    // write the command buffer for the frame, once, in submit order
+    void buildCommands()
+    {
+        multiDraw->clear();
+        runs.assign(sorted.size(), -1);
+        drawRuns.clear();
+        for (size_t i = 0; i < sorted.size();)
+        {
+            const RenderItem& first = items[sorted[i].item];
+            if (!isMultiDrawable(first))
+            {
+                i++;
+                continue;
+            }
+
+            DrawRun run = {i, multiDraw->commands.size(), 0};
+            size_t start = i;
+            for (; i < sorted.size(); i++)
+            {
+                const RenderItem& item = items[sorted[i].item];
+                if (!isMultiDrawable(item) || !canMerge(first, item))
+                    break;
+                if (multiDraw->add({(GLuint)item.indexCount, (GLuint)item.instanceCount, item.firstIndex, item.baseVertex, item.baseInstance}) >= 0)
+                    run.commandCount++;
+            }
+            run.end = i;
+            runs[start] = (int)drawRuns.size();
+            drawRuns.push_back(run);
+        }
+        multiDraw->upload();
+    }
+
+    void submitRange(const UniformRing& objectRing, size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; i++)
+        {
+            const RenderItem& item = items[sorted[i].item];
+            glState.useProgram(item.program);
+            glState.bindVertexArray(item.VAO);
+            if (item.objectOffset >= 0)
+                objectRing.bind(item.objectOffset);
+
+            if (!runs.empty() && runs[i] >= 0)
+            {
+                const DrawRun& run = drawRuns[runs[i]];
+                drawCalls += multiDraw->draw(run.firstCommand, run.commandCount);
+                i = run.end - 1;
+                continue;
+            }
+
+            const void* indices = (const void*)(item.firstIndex * sizeof(GLuint));
+            if (item.instanceCount > 0)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT, indices, item.instanceCount, item.baseVertex);
+            else
+                glDrawElementsBaseVertex(GL_TRIANGLES, item.indexCount, GL_UNSIGNED_INT, indices, item.baseVertex);
+            drawCalls++;
+        }
+    }
+};
+
+#endif /* render_queue_h */
@@ -0,0 +1,267 @@
+//
+//  scene.h
+//  3D Object Drawing
+//
+//  Flat scene description in structure-of-arrays layout. Parents are always
+//  stored before their children, and world matrices (and the normal
+//  matrices that go with them) are recomputed only for dirty subtrees.
+//
+
+#ifndef scene_h
+#define scene_h
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/simd/matrix.h>
+
+#include "bounds.h"
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+// mesh id of a node that only groups its children
+const int MESH_NONE = -1;
+
+// out = a * b, through glm's SSE kernel when intrinsics are enabled (GLM_FORCE_INTRINSICS)
+inline void multiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    // unaligned loads: glm::mat4 is only guaranteed float alignment
+    glm_vec4 lhs[4], rhs[4], result[4];
+    for (int column = 0; column < 4; column++)
+    {
+        lhs[column] = _mm_loadu_ps(&a[column][0]);
+        rhs[column] = _mm_loadu_ps(&b[column][0]);
+    }
+    glm_mat4_mul(lhs, rhs, result);
+    for (int column = 0; column < 4; column++)
+        _mm_storeu_ps(&out[column][0], result[column]);
+#else
+    out = a * b;
+#endif
+}
+
+// inverse transpose of an affine matrix's upper 3x3, for transforming normals. Built
+// from the cofactors (three cross products and a dot) instead of a full inverse; for
+// a TRS matrix it comes out as R * S^-1. Singular matrices give zero
+inline glm::mat3 normalMatrix(const glm::mat4& m)
+{
+    glm::vec3 x(m[0]), y(m[1]), z(m[2]);
+    glm::vec3 yz = glm::cross(y, z), zx = glm::cross(z, x), xy = glm::cross(x, y);
+    float determinant = glm::dot(x, yz);
+    if (determinant == 0.0f)
+        return glm::mat3(0.0f);
+    return glm::mat3(yz, zx, xy) * (1.0f / determinant);
+}
+
+// Euler angles in degrees, applied X then Y then Z like the old draw functions
+inline glm::quat eulerDegreesToQuat(const glm::vec3& degrees)
+{
+    return glm::angleAxis(glm::radians(degrees.x), glm::vec3(1.0f, 0.0f, 0.0f)) *
+           glm::angleAxis(glm::radians(degrees.y), glm::vec3(0.0f, 1.0f, 0.0f)) *
+           glm::angleAxis(glm::radians(degrees.z), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+class Scene
+{
+public:
+    // node data; index i of every array describes node i
+    std::vector<int> meshes;          // index into the renderer's mesh table, or MESH_NONE
+    std::vector<int> parents;         // parent node, -1 for a root; always lower than the node's own index
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::vec3> pivots;    // applied before scaling; centers the unit primitives
+    std::vector<glm::vec4> colors;
+    std::vector<int> drawGroups;      // renderer-defined bucket (e.g. walls, fan), see nextDrawGroup
+    std::vector<unsigned char> movable; // local transform is animated after load, see setMovable()
+    std::vector<unsigned char> dirty;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat3> normalWorlds; // normalMatrix(worlds[i]), refreshed with the world matrix
+
+    // world bounds of the drawable (mesh) nodes; slot i belongs to node drawables[i]
+    std::vector<int> drawables;
+    BoundsSoA worldBounds;
+    std::vector<int> changedDrawables; // slots whose world bounds the last updateTransforms() changed
+
+    // draw group given to nodes added from now on
+    int nextDrawGroup = 0;
+
+    // statistics for the last updateTransforms()
+    unsigned int nodesUpdated = 0;
+
+    // bumped whenever the set of static nodes or their placement under their root changes
+    unsigned int staticVersion = 0;
+
+    size_t size() const
+    {
+        return meshes.size();
+    }
+
+    // transform-only node
+    int addGroup(int parent,
+                 float posX = 0.0f, float posY = 0.0f, float posZ = 0.0f,
+                 float rotX = 0.0f, float rotY = 0.0f, float rotZ = 0.0f)
+    {
+        return push(MESH_NONE, parent, glm::vec3(posX, posY, posZ), eulerDegreesToQuat(glm::vec3(rotX, rotY, rotZ)),
+                    glm::vec3(1.0f), glm::vec3(0.0f), glm::vec4(0.0f));
+    }
+
+    // drawable node; the primitive is centered the same way the old draw functions did,
+    // so children of a mesh node would inherit that centering
+    int addMesh(int mesh, int parent,
+                float posX, float posY, float posZ,
+                float rotX, float rotY, float rotZ,
+                float scX, float scY, float scZ,
+                glm::vec4 color)
+    {
+        return push(mesh, parent, glm::vec3(posX, posY, posZ), eulerDegreesToQuat(glm::vec3(rotX, rotY, rotZ)),
+                    glm::vec3(scX, scY, scZ), glm::vec3(-0.25f), color);
+    }
+
+    // a movable node and everything below it stays off the static path
+    void setMovable(int index, bool isMovable = true)
+    {
+        if (movable[index] == (isMovable ? 1 : 0))
+            return;
+        movable[index] = isMovable ? 1 : 0;
+        staticVersion++;
+    }
+
+    // true if neither the node nor any ancestor below the root is movable, so the
+    // node keeps a fixed placement relative to its root
+    bool isStatic(int index) const
+    {
+        for (int i = index; parents[i] >= 0; i = parents[i])
+            if (movable[i])
+                return false;
+        return true;
+    }
+
+    // transform from a node's space to one of its ancestors' (-1 for world space)
+    glm::mat4 relativeMatrix(int index, int ancestor) const
+    {
+        glm::mat4 result = localMatrix(index);
+        for (int i = parents[index]; i != ancestor && i >= 0; i = parents[i])
+            result = localMatrix(i) * result;
+        return result;
+    }
+
+    // local bounds of a mesh id; recomputes every node's world bounds on the next update
+    void setMeshBounds(int mesh, const Bounds& bounds)
+    {
+        if ((int)meshBounds.size() <= mesh)
+            meshBounds.resize(mesh + 1);
+        meshBounds[mesh] = bounds;
+        std::fill(dirty.begin(), dirty.end(), 1);
+        anyDirty = true;
+    }
+
+    // change a node's local transform; only marks it dirty when something changed
+    void setTransform(int index, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        if (positions[index] == position && rotations[index] == rotation && scales[index] == scale)
+            return;
+        positions[index] = position;
+        rotations[index] = rotation;
+        scales[index] = scale;
+        dirty[index] = 1;
+        anyDirty = true;
+        // roots carry static subtrees along; any other fixed node moved inside its root
+        if (!movable[index] && parents[index] >= 0)
+            staticVersion++;
+    }
+    void setTransform(int index, const glm::vec3& position, const glm::vec3& rotationDegrees, const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        setTransform(index, position, eulerDegreesToQuat(rotationDegrees), scale);
+    }
+
+    // recompute world matrices of dirty nodes and everything below them
+    void updateTransforms()
+    {
+        nodesUpdated = 0;
+        changedDrawables.clear();
+        if (!anyDirty)
+            return;
+
+        // parents precede children, so one forward pass sees every parent's
+        // final world matrix and dirty flag before its children
+        const size_t count = size();
+        for (size_t i = 0; i < count; i++)
+        {
+            int parent = parents[i];
+            if (parent >= 0 && dirty[parent])
+                dirty[i] = 1;
+            if (!dirty[i])
+                continue;
+
+            glm::mat4 local = localMatrix(i);
+            if (parent >= 0)
+                multiplyMat4(worlds[parent], local, worlds[i]);
+            else
+                worlds[i] = local;
+            normalWorlds[i] = normalMatrix(worlds[i]);
+            if (drawableSlots[i] >= 0 && meshes[i] < (int)meshBounds.size())
+            {
+                worldBounds.set(drawableSlots[i], transformBounds(meshBounds[meshes[i]], worlds[i]));
+                changedDrawables.push_back(drawableSlots[i]);
+            }
+            nodesUpdated++;
+        }
+
+        // cleared afterwards so every descendant above saw its parent's flag
+        std::fill(dirty.begin(), dirty.end(), 0);
+        anyDirty = false;
+    }
+
+private:
+    bool anyDirty = false;
+    std::vector<Bounds> meshBounds;
+    std::vector<int> drawableSlots; // per node, index into drawables or -1
+
+    int push(int mesh, int parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale, glm::vec3 pivot, glm::vec4 color)
+    {
+        assert(parent < (int)size());
+        meshes.push_back(mesh);
+        parents.push_back(parent);
+        positions.push_back(position);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        pivots.push_back(pivot);
+        colors.push_back(color);
+        drawGroups.push_back(nextDrawGroup);
+        movable.push_back(0);
+        dirty.push_back(1);
+        worlds.push_back(glm::mat4(1.0f));
+        normalWorlds.push_back(glm::mat3(1.0f));
+        if (mesh != MESH_NONE)
+        {
+            drawableSlots.push_back((int)drawables.size());
+            drawables.push_back((int)size() - 1);
+            worldBounds.resize(drawables.size());
+        }
+        else
+        {
+            drawableSlots.push_back(-1);
+        }
+        anyDirty = true;
+        staticVersion++;
+        return (int)size() - 1;
+    }
+
+    // translate * rotate * scale * translate(pivot), built directly from the quaternion
+    glm::mat4 localMatrix(size_t i) const
+    {
+        glm::mat3 rotation = glm::mat3_cast(rotations[i]);
+        const glm::vec3& scale = scales[i];
+        glm::mat4 local;
+        local[0] = glm::vec4(rotation[0] * scale.x, 0.0f);
+        local[1] = glm::vec4(rotation[1] * scale.y, 0.0f);
+        local[2] = glm::vec4(rotation[2] * scale.z, 0.0f);
+        local[3] = glm::vec4(positions[i] + rotation * (scale * pivots[i]), 1.0f);
+        return local;
+    }
+};
+
+#endif /* scene_h */
@@ -11,141 +11,370 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include "program_cache.h"
+#include "shader_source.h"
+
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+
+// pre-resolved uniform location; -1 means the uniform is not active
+struct UniformHandle
+{
+    GLint location = -1;
+
+    bool valid() const { return location != -1; }
+};
 
 class Shader
 {
 public:
-    unsigned int ID;
-    // constructor generates the shader on the fly
-    // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
+    unsigned int ID = 0;
+    // glUniform* calls made through the setters since startup
+    mutable unsigned int uniformUploads = 0;
+    // true if the program came from the binary cache instead of being compiled
+    bool fromCache = false;
+    // passed to construct a shader whose build is left to a ShaderCompiler
+    enum Deferred { DEFERRED };
+    // constructor generates the shader on the fly, or loads it from cache when given one;
+    // the sources may #include other files and get the variant's defines injected
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache = NULL,
+           const ShaderDefines& defines = ShaderDefines())
+        : Shader(vertexPath, fragmentPath, cache, defines, DEFERRED)
+    {
+        build();
+        finishBuild();
+        activate();
+    }
+    // a pending shader: nothing is compiled and ID stays 0 until build() runs
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache, const ShaderDefines& defines, Deferred)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), cache(cache), defines(defines)
+    {
+    }
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    // the build in steps, so it can overlap with rendering; build() and finishBuild()
+    // may run on another thread with a context sharing this one's objects, activate()
+    // runs on the thread that draws. Only a ready() shader may be used
+    // ------------------------------------------------------------------------
+    // issue the compile and link, or load the cached binary
+    void build()
+    {
+        // 1. retrieve the vertex/fragment source code from filePath, includes expanded
+        vertexSource = loadShaderSource(vertexPath, defines);
+        fragmentSource = loadShaderSource(fragmentPath, defines);
+        const std::string& vertexCode = vertexSource.text;
+        const std::string& fragmentCode = fragmentSource.text;
+        ID = glCreateProgram();
+        // 2. a cached binary of the same sources on the same driver skips compilation
+        if (cache != NULL && vertexSource.ok && fragmentSource.ok)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            cacheKey = cache->key({ vertexCode, fragmentCode }, defines.text());
+            fromCache = cache->load(cacheKey, ID);
+            if (fromCache)
+                return;
         }
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 3. compile shaders; the status is read in finishBuild(), reading it here
+        // would wait for a parallel compile
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (cache != NULL)
+            cache->prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    }
+    // true once finishBuild() won't block; with KHR_parallel_shader_compile the driver
+    // is asked without waiting, otherwise the link already finished in build()
+    bool buildComplete() const
+    {
+        if (fromCache || !glExtensions.parallelShaderCompile)
+            return true;
+        GLint complete = GL_TRUE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+    // report errors and store the linked binary
+    void finishBuild()
+    {
+        if (fromCache)
+        {
+            linked = true;
+            return;
+        }
+        if (!checkCompileErrors(vertex, "VERTEX"))
+            vertexSource.printFiles();
+        if (!checkCompileErrors(fragment, "FRAGMENT"))
+            fragmentSource.printFiles();
+        linked = checkCompileErrors(ID, "PROGRAM");
+        if (linked && cache != NULL)
+            cache->store(cacheKey, ID);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-
+        vertex = fragment = 0;
+    }
+    // read the active uniforms once so setters never query the driver by name
+    void activate()
+    {
+        cacheUniformLocations();
+        isReady = true;
+    }
+    bool ready() const
+    {
+        return isReady;
+    }
+    // false if the program failed to compile or link; it is still ready, but draws nothing useful
+    bool valid() const
+    {
+        return linked;
+    }
+    // true if path, compared as a normalized relative path, is one of the files the
+    // sources were read from, includes too; known once build() ran
+    bool readsFile(const std::string& path) const
+    {
+        for (const ShaderSource* source : { &vertexSource, &fragmentSource })
+            for (const std::string& file : source->files)
+                if (std::filesystem::path(file).lexically_normal() == std::filesystem::path(path).lexically_normal())
+                    return true;
+        return false;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     {
-        glUseProgram(ID);
+        glState.useProgram(ID);
+    }
+    // look up a cached uniform location; resolve handles once, outside the render loop
+    // ------------------------------------------------------------------------
+    UniformHandle uniform(const char* name) const
+    {
+        UniformHandle handle;
+        if (uniformTable.empty())
+            return handle;
+        uint32_t hash = hashName(name);
+        size_t mask = uniformTable.size() - 1;
+        for (size_t i = hash & mask; uniformTable[i].location != -1; i = (i + 1) & mask)
+        {
+            if (uniformTable[i].hash == hash && uniformTable[i].name == name)
+            {
+                handle.location = uniformTable[i].location;
+                break;
+            }
+        }
+        return handle;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(const char* name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(uniform(name), value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(const char* name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(uniform(name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(const char* name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(uniform(name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(const char* name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniform(name), value);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const char* name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        setVec2(uniform(name), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(const char* name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(uniform(name), value);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(const char* name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        setVec3(uniform(name), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(const char* name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec4(uniform(name), value);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w) const
+    void setVec4(const char* name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        setVec4(uniform(name), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(const char* name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat2(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(const char* name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat3(uniform(name), mat);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(const char* name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        setMat4(uniform(name), mat);
+    }
+    // handle based setters for the per-frame and per-draw path
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        uniformUploads++;
+        glUniform1i(handle.location, (int)value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        uniformUploads++;
+        glUniform1i(handle.location, value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        uniformUploads++;
+        glUniform1f(handle.location, value);
+    }
+    void setVec2(UniformHandle handle, const glm::vec2& value) const
+    {
+        uniformUploads++;
+        glUniform2fv(handle.location, 1, &value[0]);
+    }
+    void setVec3(UniformHandle handle, const glm::vec3& value) const
+    {
+        uniformUploads++;
+        glUniform3fv(handle.location, 1, &value[0]);
+    }
+    void setVec4(UniformHandle handle, const glm::vec4& value) const
+    {
+        uniformUploads++;
+        glUniform4fv(handle.location, 1, &value[0]);
+    }
+    void setMat2(UniformHandle handle, const glm::mat2& mat) const
+    {
+        uniformUploads++;
+        glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformHandle handle, const glm::mat3& mat) const
+    {
+        uniformUploads++;
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle handle, const glm::mat4& mat) const
+    {
+        uniformUploads++;
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    ProgramCache* cache = NULL;
+    ShaderDefines defines;
+    ShaderSource vertexSource, fragmentSource;
+    uint64_t cacheKey = 0;
+    unsigned int vertex = 0, fragment = 0;
+    bool linked = false;
+    bool isReady = false;
+
+    struct UniformEntry
+    {
+        uint32_t hash = 0;
+        GLint location = -1;
+        std::string name;
+    };
+    // open addressing table, power of two sized, empty slots have location -1
+    std::vector<UniformEntry> uniformTable;
+
+    static uint32_t hashName(const char* name)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (; *name; ++name)
+        {
+            hash ^= (unsigned char)*name;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void insertUniform(const std::string& name, GLint location)
+    {
+        uint32_t hash = hashName(name.c_str());
+        size_t mask = uniformTable.size() - 1;
+        size_t i = hash & mask;
+        while (uniformTable[i].location != -1)
+            i = (i + 1) & mask;
+        uniformTable[i].hash = hash;
+        uniformTable[i].location = location;
+        uniformTable[i].name = name;
+    }
+
+    void cacheUniformLocations()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        // gather names first; arrays of basic types report only "name[0]"
+        std::vector<std::pair<std::string, GLint>> found;
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), NULL, &size, &type, buffer.data());
+            std::string name(buffer.data());
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location == -1)
+                continue; // uniform block member
+            found.emplace_back(name, location);
+
+            size_t bracket = name.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size())
+            {
+                std::string base = name.substr(0, bracket);
+                found.emplace_back(base, location);
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    found.emplace_back(elementName, glGetUniformLocation(ID, elementName.c_str()));
+                }
+            }
+        }
+
+        size_t capacity = 16;
+        while (capacity < found.size() * 2)
+            capacity *= 2;
+        uniformTable.assign(capacity, UniformEntry());
+        for (const auto& entry : found)
+            insertUniform(entry.first, entry.second);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    // returns true on success
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -167,6 +396,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
 #endif
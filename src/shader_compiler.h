@@ -0,0 +1,238 @@
+//
+//  shader_compiler.h
+//  3D Object Drawing
+//
+//  Builds shader programs off the render path. A submitted shader stays
+//  pending while it compiles and poll(), called once per frame, activates
+//  the ones that finished, so draws keep going with whatever program they
+//  already have. With KHR_parallel_shader_compile the driver compiles on
+//  its own threads and poll() only asks GL_COMPLETION_STATUS_KHR; without
+//  it a worker thread builds the programs in a second context that shares
+//  objects with the main one. If neither is set up, submit() builds at once.
+//
+
+#ifndef shader_compiler_h
+#define shader_compiler_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+#include "shader.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+
+class ShaderCompiler
+{
+public:
+    enum Mode
+    {
+        COMPILE_SYNCHRONOUS,
+        COMPILE_PARALLEL, // KHR_parallel_shader_compile
+        COMPILE_WORKER    // worker thread with a shared context
+    };
+    Mode mode = COMPILE_SYNCHRONOUS;
+
+    // statistics
+    unsigned int programsBuilt = 0;
+    unsigned int waits = 0;   // builds the main thread had to block on
+    double latencyMs = 0.0;   // from submit() to ready, summed over programsBuilt
+
+    ~ShaderCompiler()
+    {
+        stop();
+    }
+
+    // let the driver compile in parallel; needs the extension loaded
+    bool startParallel()
+    {
+        if (!glExtensions.parallelShaderCompile)
+            return false;
+        glExtensions.MaxShaderCompilerThreads(0xFFFFFFFFu); // as many as the driver likes
+        mode = COMPILE_PARALLEL;
+        return true;
+    }
+
+    // build on a worker thread; bindContext makes a context sharing the main one's
+    // objects current on the calling thread, unbindContext releases it again
+    bool startWorker(std::function<bool()> bindContext, std::function<void()> unbindContext)
+    {
+        bool bound = false, started = false;
+        worker = std::thread([this, bindContext, unbindContext, &bound, &started]()
+        {
+            bool ok = bindContext();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                bound = ok;
+                started = true;
+            }
+            wake.notify_all();
+            if (ok)
+            {
+                run();
+                unbindContext();
+            }
+        });
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return started; });
+        lock.unlock();
+        if (!bound)
+        {
+            worker.join();
+            std::cout << "WARNING::SHADER_COMPILER: can't make the worker context current, compiling synchronously" << std::endl;
+            return false;
+        }
+        mode = COMPILE_WORKER;
+        return true;
+    }
+
+    // start building a shader constructed with Shader::DEFERRED
+    void submit(Shader& shader)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (mode == COMPILE_SYNCHRONOUS)
+        {
+            shader.build();
+            shader.finishBuild();
+            shader.activate();
+            latencyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            programsBuilt++;
+            return;
+        }
+        pending.push_back({&shader, start});
+        if (mode == COMPILE_PARALLEL)
+        {
+            shader.build();
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(&shader);
+            wake.notify_all();
+        }
+    }
+
+    // activate every pending shader whose build finished; never blocks on the driver
+    void poll()
+    {
+        if (pending.empty())
+            return;
+        std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+        if (mode == COMPILE_WORKER)
+            lock.lock();
+        for (size_t i = 0; i < pending.size();)
+        {
+            Shader& shader = *pending[i].shader;
+            if (finished(shader))
+                activate(i);
+            else
+                i++;
+        }
+    }
+
+    // block until shader is ready; for when a draw can't go on without it
+    void wait(Shader& shader)
+    {
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            if (pending[i].shader != &shader)
+                continue;
+            waits++;
+            if (mode == COMPILE_WORKER)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // jump the queue if the worker hasn't started on it yet
+                auto queued = std::find(queue.begin(), queue.end(), &shader);
+                if (queued != queue.end() && queued != queue.begin())
+                {
+                    queue.erase(queued);
+                    queue.push_front(&shader);
+                }
+                wake.wait(lock, [&]() { return finished(shader); });
+                activate(i);
+                return;
+            }
+            activate(i);
+            return;
+        }
+    }
+
+    // stop the worker; shaders it hasn't built yet stay pending for good
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+private:
+    struct PendingShader
+    {
+        Shader* shader;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    std::vector<PendingShader> pending; // main thread only
+
+    // worker state, guarded by mutex
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Shader*> queue;
+    std::vector<Shader*> built;
+    bool stopping = false;
+
+    // the build is done and finishBuild() has run or won't block; worker mode needs the lock
+    bool finished(Shader& shader) const
+    {
+        if (mode == COMPILE_WORKER)
+            return std::find(built.begin(), built.end(), &shader) != built.end();
+        return shader.buildComplete();
+    }
+
+    void activate(size_t index)
+    {
+        Shader& shader = *pending[index].shader;
+        if (mode == COMPILE_WORKER)
+            built.erase(std::find(built.begin(), built.end(), &shader));
+        else
+            shader.finishBuild();
+        shader.activate();
+        latencyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending[index].submitted).count();
+        programsBuilt++;
+        pending.erase(pending.begin() + index);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            Shader* shader = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            shader->build();
+            shader->finishBuild();
+            // the program must be complete before another context uses it
+            glFinish();
+            lock.lock();
+            built.push_back(shader);
+            wake.notify_all();
+        }
+    }
+};
+
+#endif /* shader_compiler_h */
@@ -0,0 +1,127 @@
+//
+//  shader_source.h
+//  3D Object Drawing
+//
+//  Loads GLSL for compilation: #include "file" lines are replaced by the
+//  file's text (paths relative to the including file, each file at most
+//  once), and a variant's #defines are injected right after #version.
+//  #line directives keep compiler messages pointing at the right file
+//  and line; the source string numbers index ShaderSource::files.
+//
+
+#ifndef shader_source_h
+#define shader_source_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// the #defines of one shader variant; kept sorted so equal sets give equal text
+class ShaderDefines
+{
+public:
+    ShaderDefines& set(const std::string& name, int value)
+    {
+        values[name] = value;
+        return *this;
+    }
+
+    std::string text() const
+    {
+        std::string result;
+        for (const auto& entry : values)
+            result += "#define " + entry.first + " " + std::to_string(entry.second) + "\n";
+        return result;
+    }
+
+private:
+    std::map<std::string, int> values;
+};
+
+struct ShaderSource
+{
+    std::string text;
+    std::vector<std::string> files; // by #line source string number
+    bool ok = true;
+
+    // write the file list under a compiler message
+    void printFiles() const
+    {
+        for (size_t i = 0; i < files.size(); i++)
+            std::cout << "  source " << i << ": " << files[i] << std::endl;
+    }
+};
+
+inline bool readShaderFile(const std::string& path, std::string& text)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    text = stream.str();
+    return true;
+}
+
+// append path's text to source with its includes expanded
+inline void expandShaderIncludes(const std::string& path, ShaderSource& source, const std::string& defines)
+{
+    std::string text;
+    if (!readShaderFile(path, text))
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        source.ok = false;
+        return;
+    }
+    int fileIndex = (int)source.files.size();
+    source.files.push_back(path);
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    std::istringstream lines(text);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line))
+    {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+        {
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << lineNumber << ": " << line << std::endl;
+                source.ok = false;
+                continue;
+            }
+            std::string included = directory + line.substr(open + 1, close - open - 1);
+            bool seen = false;
+            for (const std::string& file : source.files)
+                seen = seen || file == included;
+            if (!seen)
+            {
+                source.text += "#line 1 " + std::to_string(source.files.size()) + "\n";
+                expandShaderIncludes(included, source, std::string());
+            }
+            source.text += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            continue;
+        }
+
+        source.text += line + "\n";
+        if (start != std::string::npos && line.compare(start, 8, "#version") == 0 && !defines.empty())
+            source.text += defines + "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+    }
+}
+
+// one stage's source with includes expanded and defines injected after #version
+inline ShaderSource loadShaderSource(const std::string& path, const ShaderDefines& defines = ShaderDefines())
+{
+    ShaderSource source;
+    expandShaderIncludes(path, source, defines.text());
+    return source;
+}
+
+#endif /* shader_source_h */
@@ -0,0 +1,279 @@
+//
+//  shader_variants.h
+//  3D Object Drawing
+//
+//  Permutations of one vertex/fragment pair. A variant is named by a small
+//  integer key whose bit fields map to #defines (see VariantDefine), so the
+//  render loop can pick a variant every frame without building strings;
+//  only keys that are actually requested get compiled, each once. With a
+//  ShaderCompiler a new variant builds in the background and get() hands
+//  out a fallback meanwhile: the last variant it returned with the same
+//  fallback-mask bits (those that change the vertex inputs), or at first
+//  the fallback key's variant, which is waited for. reload() rebuilds the
+//  variants that read an edited file the same way, swapping each one in
+//  only once its new program has linked.
+//
+
+#ifndef shader_variants_h
+#define shader_variants_h
+
+#include "shader.h"
+#include "shader_compiler.h"
+#include "program_cache.h"
+#include "shader_source.h"
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+
+// a bit field of the variant key and the #define it becomes
+struct VariantDefine
+{
+    const char* name;
+    int shift;
+    int bits;
+};
+
+class ShaderVariants
+{
+public:
+    // statistics
+    unsigned int variantsBuilt = 0;
+    double buildMs = 0.0; // time get() spent creating or waiting for variants, cache loads included
+    unsigned int fallbacksUsed = 0; // get() calls answered with another variant
+    unsigned int reloads = 0;        // variants rebuilt and swapped in after a source edit
+    unsigned int reloadFailures = 0; // rebuilds that didn't link; the previous program stayed
+
+    // rebuilds started per update(), so saving a shader costs at most one build's
+    // render-thread share in any frame
+    static const unsigned int RELOADS_PER_FRAME = 1;
+
+    // setup runs once on every new variant with its key when it becomes ready,
+    // e.g. to bind uniform blocks
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, const std::vector<VariantDefine>& layout,
+                   ProgramCache* cache, std::function<void(Shader&, uint32_t)> setup)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), layout(layout), cache(cache), setup(setup)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // build new variants through compiler; until one is ready get() returns the
+    // variant for (key & fallbackMask) | fallbackBits, or a newer one with the same masked bits
+    void setCompiler(ShaderCompiler* shaderCompiler, uint32_t mask, uint32_t bits)
+    {
+        compiler = shaderCompiler;
+        fallbackMask = mask;
+        fallbackBits = bits;
+    }
+
+    // start building the variant for key without waiting for it
+    void request(uint32_t key)
+    {
+        find(key);
+    }
+
+    // the variant for key, compiled on first use; with a compiler the variant
+    // to draw with while key's own is still building
+    Shader& get(uint32_t key)
+    {
+        Variant& variant = find(key);
+        if (variant.shader->ready())
+            return use(variant, key);
+
+        fallbacksUsed++;
+        auto current = latest.find(key & fallbackMask);
+        if (current != latest.end())
+            return *current->second;
+
+        // nothing to stand in yet: wait for the fallback, which is usually smaller
+        uint32_t fallbackKey = (key & fallbackMask) | fallbackBits;
+        Variant& fallback = find(fallbackKey);
+        if (!fallback.shader->ready())
+        {
+            auto start = std::chrono::steady_clock::now();
+            compiler->wait(*fallback.shader);
+            buildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        return use(fallback, fallbackKey);
+    }
+
+    // rebuild every variant that reads one of files; each keeps drawing with its
+    // current program until the rebuilt one is ready
+    void reload(const std::vector<std::string>& files)
+    {
+        for (auto& entry : variants)
+        {
+            const Shader& shader = *entry.second.shader;
+            if (!shader.ready() || std::find(reloadQueue.begin(), reloadQueue.end(), entry.first) != reloadQueue.end())
+                continue; // a pending variant reads the files when its build starts
+            for (const std::string& file : files)
+            {
+                if (shader.readsFile(file))
+                {
+                    reloadQueue.push_back(entry.first);
+                    break;
+                }
+            }
+        }
+    }
+
+    // once per frame, after the compiler's poll(): swap in the rebuilt variants that
+    // linked, drop the ones that didn't and start the next queued rebuilds
+    void update()
+    {
+        if (rebuilding == 0 && reloadQueue.empty())
+            return;
+        for (auto& entry : variants)
+        {
+            Variant& variant = entry.second;
+            if (!variant.replacement || !variant.replacement->ready())
+                continue;
+            rebuilding--;
+            if (variant.replacement->valid())
+            {
+                swapIn(entry.first, variant);
+                continue;
+            }
+            std::cout << "WARNING::SHADER_VARIANTS: variant 0x" << std::hex << entry.first << std::dec
+                      << " didn't build, keeping its previous program" << std::endl;
+            glDeleteProgram(variant.replacement->ID);
+            variant.replacement.reset();
+            reloadFailures++;
+        }
+
+        unsigned int started = 0;
+        for (size_t i = 0; i < reloadQueue.size() && started < RELOADS_PER_FRAME;)
+        {
+            Variant& variant = variants[reloadQueue[i]];
+            if (variant.replacement)
+            {
+                i++; // still building an earlier edit; rebuilt again after it lands
+                continue;
+            }
+            variant.replacement = create(reloadQueue[i]);
+            rebuilding++;
+            started++;
+            reloadQueue.erase(reloadQueue.begin() + i);
+        }
+    }
+
+    // glUniform* calls made through every variant's setters
+    unsigned int uniformUploads() const
+    {
+        unsigned int total = 0;
+        for (const auto& entry : variants)
+            total += entry.second.shader->uniformUploads;
+        return total;
+    }
+
+    // delete every variant's program; needs a current GL context and the compiler stopped
+    void release()
+    {
+        for (auto& entry : variants)
+        {
+            glState.forgetProgram(entry.second.shader->ID);
+            glDeleteProgram(entry.second.shader->ID);
+            if (entry.second.replacement)
+                glDeleteProgram(entry.second.replacement->ID);
+        }
+        variants.clear();
+        latest.clear();
+        reloadQueue.clear();
+        rebuilding = 0;
+    }
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        bool setUp = false;
+        std::unique_ptr<Shader> replacement; // rebuild after an edit, until it is swapped in
+    };
+
+    const char* vertexPath;
+    const char* fragmentPath;
+    std::vector<VariantDefine> layout;
+    ProgramCache* cache;
+    std::function<void(Shader&, uint32_t)> setup;
+    ShaderCompiler* compiler = NULL;
+    uint32_t fallbackMask = 0;
+    uint32_t fallbackBits = 0;
+    std::unordered_map<uint32_t, Variant> variants;
+    std::unordered_map<uint32_t, Shader*> latest; // last ready variant returned, by masked key
+    std::vector<uint32_t> reloadQueue;             // keys waiting for their rebuild to start
+    unsigned int rebuilding = 0;                   // replacements not ready yet
+
+    // the variant for key, submitted for building if it is new
+    Variant& find(uint32_t key)
+    {
+        auto it = variants.find(key);
+        if (it != variants.end())
+            return it->second;
+
+        auto start = std::chrono::steady_clock::now();
+        Variant& variant = variants[key];
+        variant.shader = create(key);
+        buildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        variantsBuilt++;
+        return variant;
+    }
+
+    // a new program for key, built now or submitted to the compiler
+    std::unique_ptr<Shader> create(uint32_t key)
+    {
+        ShaderDefines defines;
+        for (const VariantDefine& define : layout)
+            defines.set(define.name, (int)((key >> define.shift) & ((1u << define.bits) - 1)));
+        if (compiler == NULL)
+            return std::unique_ptr<Shader>(new Shader(vertexPath, fragmentPath, cache, defines));
+        std::unique_ptr<Shader> shader(new Shader(vertexPath, fragmentPath, cache, defines, Shader::DEFERRED));
+        compiler->submit(*shader);
+        return shader;
+    }
+
+    // replace variant's program with its linked rebuild; callers that keep uniform
+    // handles per program ID resolve them again when get() returns the new one
+    void swapIn(uint32_t key, Variant& variant)
+    {
+        Shader* previous = variant.shader.get();
+        Shader* rebuilt = variant.replacement.get();
+        if (setup)
+            setup(*rebuilt, key);
+        rebuilt->uniformUploads += previous->uniformUploads; // keep the running total monotonic
+        for (auto& entry : latest)
+        {
+            if (entry.second == previous)
+                entry.second = rebuilt;
+        }
+        glState.forgetProgram(previous->ID);
+        glDeleteProgram(previous->ID);
+        variant.shader = std::move(variant.replacement);
+        variant.setUp = true;
+        reloads++;
+    }
+
+    // a ready variant on its way out of get(): set up on first use and remembered as
+    // the stand-in for its masked key; a variant that failed to link never stands in
+    Shader& use(Variant& variant, uint32_t key)
+    {
+        if (!variant.setUp)
+        {
+            if (setup)
+                setup(*variant.shader, key);
+            variant.setUp = true;
+        }
+        if (variant.shader->valid())
+            latest[key & fallbackMask] = variant.shader.get();
+        return *variant.shader;
+    }
+};
+
+#endif /* shader_variants_h */
@@ -0,0 +1,155 @@
+//
+//  shader_watcher.h
+//  3D Object Drawing
+//
+//  Reports shader sources (.vs, .fs, .glsl) written in a directory, so the
+//  programs built from them can be rebuilt while the renderer runs. On
+//  Linux an inotify descriptor is read without blocking once per frame;
+//  elsewhere the files found at open() have their modification times
+//  compared twice a second.
+//
+
+#ifndef shader_watcher_h
+#define shader_watcher_h
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+class ShaderWatcher
+{
+public:
+    bool watching = false;
+
+    // statistics
+    unsigned int changes = 0; // files reported by poll()
+
+    ~ShaderWatcher()
+    {
+        close();
+    }
+
+    bool open(const std::string& shaderDirectory)
+    {
+        directory = shaderDirectory;
+#ifdef __linux__
+        descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // editors either rewrite the file in place or rename a new one over it
+        if (descriptor < 0 || inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            std::cout << "WARNING::SHADER_WATCHER: can't watch " << directory << ": " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+#else
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (isShaderFile(entry.path().filename().string()))
+                files.push_back({entry.path(), entry.last_write_time(error)});
+        }
+        if (error)
+        {
+            std::cout << "WARNING::SHADER_WATCHER: can't list " << directory << ": " << error.message() << std::endl;
+            return false;
+        }
+        lastCheck = std::chrono::steady_clock::now();
+#endif
+        watching = true;
+        return true;
+    }
+
+    // shader files written since the last call, each once, as paths like the ones
+    // the shaders were loaded with; never blocks
+    const std::vector<std::string>& poll()
+    {
+        changed.clear();
+        if (!watching)
+            return changed;
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        for (;;)
+        {
+            ssize_t length = read(descriptor, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; // EAGAIN: nothing more to read
+            for (ssize_t offset = 0; offset < length;)
+            {
+                const inotify_event* event = (const inotify_event*)(buffer + offset);
+                if (event->len > 0 && isShaderFile(event->name))
+                    add((std::filesystem::path(directory) / event->name).lexically_normal().string());
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+#else
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastCheck < std::chrono::milliseconds(500))
+            return changed;
+        lastCheck = now;
+        for (WatchedFile& file : files)
+        {
+            std::error_code error;
+            auto written = std::filesystem::last_write_time(file.path, error);
+            if (!error && written != file.written)
+            {
+                file.written = written;
+                add(file.path.lexically_normal().string());
+            }
+        }
+#endif
+        changes += (unsigned int)changed.size();
+        return changed;
+    }
+
+    void close()
+    {
+#ifdef __linux__
+        if (descriptor >= 0)
+            ::close(descriptor);
+        descriptor = -1;
+#else
+        files.clear();
+#endif
+        watching = false;
+    }
+
+private:
+    std::string directory;
+    std::vector<std::string> changed;
+#ifdef __linux__
+    int descriptor = -1;
+#else
+    struct WatchedFile
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type written;
+    };
+    std::vector<WatchedFile> files;
+    std::chrono::steady_clock::time_point lastCheck;
+#endif
+
+    static bool isShaderFile(const std::string& name)
+    {
+        std::string extension = std::filesystem::path(name).extension().string();
+        return extension == ".vs" || extension == ".fs" || extension == ".glsl";
+    }
+
+    void add(const std::string& path)
+    {
+        if (std::find(changed.begin(), changed.end(), path) == changed.end())
+            changed.push_back(path);
+    }
+};
+
+#endif /* shader_watcher_h */
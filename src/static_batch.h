@@ -0,0 +1,216 @@
+//
+//  static_batch.h
+//  3D Object Drawing
+//
+//  Bakes every static drawable under one root into a single vertex/index
+//  buffer in the root's space, with the object color as a vertex attribute,
+//  so the fixed part of the room is one draw call. The root's world matrix
+//  is applied at draw time, so the room can still move as a whole; nodes
+//  marked movable (and their subtrees) stay on the dynamic path. The
+//  vertices and indices are sub-allocated from the geometry buffer arena,
+//  and a rebuild hands the old ranges back.
+//
+
+#ifndef static_batch_h
+#define static_batch_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "buffer_arena.h"
+#include "mesh_cache.h"
+#include "scene.h"
+#include "bounds.h"
+#include "frame_arena.h"
+#include "vertex_format.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// layout matches object.vs without INSTANCED; positions stay float since the room
+// spans several units, where halves would open cracks between objects
+struct StaticVertex
+{
+    glm::vec3 position;
+    uint32_t normal; // snorm 10-10-10-2
+    uint32_t color;  // unorm8 rgba
+};
+
+class StaticBatch
+{
+public:
+    // per drawable slot, 1 if the slot is drawn by the batch instead of on its own
+    std::vector<unsigned char> batched;
+    Bounds bounds; // root space
+    unsigned int VAO = 0;
+    GLsizei indexCount = 0;
+    GLuint firstIndex = 0; // in indices, not bytes
+    GLint baseVertex = 0;
+
+    // statistics
+    unsigned int builds = 0;
+    unsigned int objectsBatched = 0;
+
+    StaticBatch(BufferArena& buffer) : buffer(buffer)
+    {
+    }
+
+    ~StaticBatch()
+    {
+        release();
+    }
+
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    bool needsRebuild(const Scene& scene) const
+    {
+        return !built || version != scene.staticVersion;
+    }
+
+    // meshTable maps the scene's mesh ids to cached meshes; world bounds must be current.
+    // The merged vertices are staged in the frame arena
+    void build(const Scene& scene, int root, const MeshCache& meshCache, const MeshHandle* meshTable, FrameArena& scratch)
+    {
+        batched.assign(scene.drawables.size(), 0);
+
+        // small objects first, so the walls and floor that cover most of the screen
+        // are drawn last and mostly rejected by the depth test
+        FrameVector<int> slots(scratch);
+        for (size_t slot = 0; slot < scene.drawables.size(); slot++)
+            if (isUnder(scene, scene.drawables[slot], root) && scene.isStatic(scene.drawables[slot]))
+                slots.push_back((int)slot);
+        std::sort(slots.begin(), slots.end(), [&](int a, int b)
+                  { return scene.worldBounds.radius[a] < scene.worldBounds.radius[b]; });
+
+        // sized up front, since a growing arena vector leaves its old storage behind
+        size_t vertexTotal = 0, indexTotal = 0;
+        for (int slot : slots)
+        {
+            if (const MeshGeometry* geometry = meshCache.getGeometry(meshTable[scene.meshes[scene.drawables[slot]]]))
+            {
+                vertexTotal += geometry->positions.size();
+                indexTotal += geometry->indices.size();
+            }
+        }
+        FrameVector<StaticVertex> vertices(scratch);
+        FrameVector<unsigned int> indices(scratch);
+        vertices.reserve(vertexTotal);
+        indices.reserve(indexTotal);
+        for (int slot : slots)
+        {
+            int node = scene.drawables[slot];
+            const MeshGeometry* geometry = meshCache.getGeometry(meshTable[scene.meshes[node]]);
+            if (geometry == NULL)
+                continue;
+
+            // the shaders transform normals by the inverse transpose; baking the node's part
+            // here leaves the root's part to the draw, which composes to the same result
+            glm::mat4 toRoot = scene.relativeMatrix(node, root);
+            glm::mat3 normalToRoot = normalMatrix(toRoot);
+            unsigned int baseVertex = (unsigned int)vertices.size();
+            for (size_t i = 0; i < geometry->positions.size(); i++)
+            {
+                StaticVertex vertex;
+                vertex.position = glm::vec3(toRoot * glm::vec4(geometry->positions[i], 1.0f));
+                vertex.normal = packNormal(normalToRoot * geometry->normals[i]);
+                vertex.color = packColor(scene.colors[node]);
+                vertices.push_back(vertex);
+            }
+            for (unsigned int index : geometry->indices)
+                indices.push_back(baseVertex + index);
+            batched[slot] = 1;
+        }
+
+        indexCount = upload(vertices, indices) ? (GLsizei)indices.size() : 0;
+        objectsBatched = (unsigned int)slots.size();
+        bounds = vertices.empty() ? Bounds() : computeBounds(&vertices[0].position.x, vertices.size(), sizeof(StaticVertex) / sizeof(float));
+        version = scene.staticVersion;
+        built = true;
+        builds++;
+    }
+
+    // refresh base vertex and first index after the buffer arena was defragmented
+    void relocate()
+    {
+        if (vertexAllocation == BufferArena::INVALID)
+            return;
+        baseVertex = (GLint)(buffer.offset(vertexAllocation) / sizeof(StaticVertex));
+        firstIndex = (GLuint)(buffer.offset(indexAllocation) / sizeof(GLuint));
+    }
+
+    // free the VAO and the arena ranges; needs a current GL context
+    void release()
+    {
+        if (VAO != 0)
+        {
+            glState.forgetVertexArray(VAO);
+            glDeleteVertexArrays(1, &VAO);
+            VAO = 0;
+        }
+        freeRanges();
+        built = false;
+    }
+
+private:
+    BufferArena& buffer;
+    unsigned int vertexAllocation = BufferArena::INVALID;
+    unsigned int indexAllocation = BufferArena::INVALID;
+    unsigned int version = 0;
+    bool built = false;
+
+    static bool isUnder(const Scene& scene, int node, int root)
+    {
+        for (int i = node; i >= 0; i = scene.parents[i])
+            if (i == root)
+                return true;
+        return false;
+    }
+
+    void freeRanges()
+    {
+        buffer.free(vertexAllocation);
+        buffer.free(indexAllocation);
+        vertexAllocation = indexAllocation = BufferArena::INVALID;
+    }
+
+    // the VAO is created once over the arena's buffer; a rebuild only swaps the ranges,
+    // which the draw addresses by base vertex and first index. Returns false if the
+    // arena had no room
+    bool upload(const FrameVector<StaticVertex>& vertices, const FrameVector<unsigned int>& indices)
+    {
+        if (VAO == 0)
+        {
+            glGenVertexArrays(1, &VAO);
+            glState.bindVertexArray(VAO);
+            glState.bindBuffer(GL_ARRAY_BUFFER, buffer.buffer);
+            glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.buffer);
+            VertexLayout(sizeof(StaticVertex))
+                .add(0, 3, GL_FLOAT, GL_FALSE, offsetof(StaticVertex, position))
+                .add(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(StaticVertex, normal))
+                .add(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(StaticVertex, color))
+                .apply();
+            glState.bindVertexArray(0);
+        }
+
+        freeRanges();
+        if (vertices.empty() || indices.empty())
+            return false;
+        vertexAllocation = buffer.allocate(vertices.size() * sizeof(StaticVertex), sizeof(StaticVertex));
+        indexAllocation = buffer.allocate(indices.size() * sizeof(GLuint), sizeof(GLuint));
+        if (vertexAllocation == BufferArena::INVALID || indexAllocation == BufferArena::INVALID)
+        {
+            freeRanges();
+            return false;
+        }
+        buffer.write(vertexAllocation, 0, vertices.size() * sizeof(StaticVertex), vertices.data());
+        buffer.write(indexAllocation, 0, indices.size() * sizeof(GLuint), indices.data());
+        relocate();
+        return true;
+    }
+};
+
+#endif /* static_batch_h */
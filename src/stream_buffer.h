@@ -0,0 +1,159 @@
+//
+//  stream_buffer.h
+//  3D Object Drawing
+//
+//  Storage for data the CPU rewrites every frame and the GPU reads in that
+//  same frame. When the stream arena is persistently mapped (ARB_buffer_storage)
+//  a range of it is split into STREAM_FRAME_REGIONS frame regions: each frame
+//  is copied straight into the mapping and its region is fenced after the
+//  draws that read it, so the CPU writes one region while the GPU may still
+//  read the others. Without a mapping, a glBufferSubData into a range the
+//  GPU is still reading would stall or be copied by the driver, so the data
+//  gets a buffer of its own instead, orphaned before every upload.
+//
+
+#ifndef stream_buffer_h
+#define stream_buffer_h
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "buffer_arena.h"
+
+#include <cstring>
+
+class StreamBuffer
+{
+public:
+    bool persistent = false; // frame regions in the mapped arena; else an orphaned buffer
+
+    // statistics
+    unsigned int fenceWaits = 0;   // beginFrame() calls that had to wait for the GPU
+    unsigned int frameUploads = 0; // orphaned uploads since beginFrame(); always 0 when persistent
+
+    // regionSize: bytes one frame writes at most, each region starts at a multiple of alignment
+    StreamBuffer(BufferArena& arena, GLsizeiptr regionSize, GLsizeiptr alignment)
+        : arena(arena), regionSize((regionSize + alignment - 1) / alignment * alignment)
+    {
+        if (arena.mapped != NULL)
+        {
+            allocation = arena.allocate(this->regionSize * STREAM_FRAME_REGIONS, alignment);
+            persistent = allocation != BufferArena::INVALID;
+            if (persistent)
+                return;
+        }
+        glGenBuffers(1, &ownBuffer);
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, ownBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, this->regionSize, NULL, GL_STREAM_DRAW);
+    }
+
+    ~StreamBuffer()
+    {
+        release();
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // the buffer to bind, the arena's or the stream's own
+    GLuint buffer() const
+    {
+        return persistent ? arena.buffer : ownBuffer;
+    }
+
+    // offset of the first region in buffer()
+    GLintptr start() const
+    {
+        return persistent ? arena.offset(allocation) : 0;
+    }
+
+    // index of the region the current frame writes; always 0 for an orphaned buffer
+    unsigned int frameRegion() const
+    {
+        return region;
+    }
+
+    // offset of the current frame's region in buffer()
+    GLintptr regionStart() const
+    {
+        return start() + region * regionSize;
+    }
+
+    // the current frame's region for writing in place, or NULL without a mapping
+    char* mapping() const
+    {
+        return persistent ? arena.mapped + regionStart() : NULL;
+    }
+
+    // move on to the next frame region, waiting for the GPU if it still reads it
+    void beginFrame()
+    {
+        frameUploads = 0;
+        if (!persistent)
+            return;
+        region = (region + 1) % STREAM_FRAME_REGIONS;
+        if (fences[region] == 0)
+            return;
+        // the region was last read STREAM_FRAME_REGIONS frames ago, so this is normally already signaled
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            fenceWaits++;
+            while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+
+    // the frame's data, size bytes at the start of its region; once per frame, since
+    // without a mapping the buffer is orphaned first and earlier writes are lost
+    void write(const void* data, GLsizeiptr size)
+    {
+        if (persistent)
+        {
+            std::memcpy(mapping(), data, size);
+            return;
+        }
+        glState.bindBuffer(GL_COPY_WRITE_BUFFER, ownBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+        frameUploads++;
+    }
+
+    // fence the region once every draw that reads it has been submitted
+    void endFrame()
+    {
+        if (persistent)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // free the fences and the storage; needs a current GL context
+    void release()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence != 0)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        arena.free(allocation);
+        allocation = BufferArena::INVALID;
+        if (ownBuffer != 0)
+        {
+            glState.forgetBuffer(ownBuffer);
+            glDeleteBuffers(1, &ownBuffer);
+            ownBuffer = 0;
+        }
+    }
+
+private:
+    BufferArena& arena;
+    GLsizeiptr regionSize;
+    unsigned int allocation = BufferArena::INVALID;
+    GLuint ownBuffer = 0;
+    unsigned int region = 0;
+    GLsync fences[STREAM_FRAME_REGIONS] = {};
+};
+
+#endif /* stream_buffer_h */
@@ -0,0 +1,141 @@
+//
+//  uniform_ring.h
+//  3D Object Drawing
+//
+//  Ring buffer for per-draw uniform blocks. Each frame's blocks are written
+//  linearly and every draw only binds its offset with glBindBufferRange.
+//
+//  The blocks live in a StreamBuffer. When the stream arena is persistently
+//  mapped (ARB_buffer_storage) they are written straight into the mapping,
+//  one fenced region per frame, so the CPU writes one region while the GPU
+//  still reads the other two. On plain GL 3.3 the frame is staged on the
+//  CPU and uploaded once into the ring's own buffer, orphaned first.
+//
+
+#ifndef uniform_ring_h
+#define uniform_ring_h
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "buffer_arena.h"
+#include "stream_buffer.h"
+#include "shader.h"
+
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+class UniformRing
+{
+public:
+    // statistics
+    bool persistent = false;     // persistently mapped path in use
+    unsigned int fenceWaits = 0; // beginFrame() calls that had to wait for the GPU
+    unsigned int uploads = 0;    // orphaned uploads in total; always 0 when persistent
+    unsigned int frameBlocks = 0;
+    unsigned int frameUploads = 0; // buffer uploads in the last flush(); always 0 when persistent
+
+    // blockSize: size of one uniform block; maxBlocks: blocks per frame
+    UniformRing(BufferArena& buffer, GLuint binding, GLsizeiptr blockSize, unsigned int maxBlocks)
+        : binding(binding), blockSize(blockSize), maxBlocks(maxBlocks),
+          stride(alignedStride(blockSize)), stream(buffer, stride * maxBlocks, uniformAlignment())
+    {
+        persistent = stream.persistent;
+        if (!persistent)
+            staging.resize(stride * maxBlocks);
+    }
+
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    // point a program's uniform block at this ring's binding
+    void attach(const Shader& shader, const char* blockName)
+    {
+        GLuint index = glGetUniformBlockIndex(shader.ID, blockName);
+        if (index == GL_INVALID_INDEX)
+        {
+            std::cout << "WARNING::UNIFORM_RING: program " << shader.ID << " has no " << blockName << std::endl;
+            return;
+        }
+        glUniformBlockBinding(shader.ID, index, binding);
+    }
+
+    // start writing the next frame
+    void beginFrame()
+    {
+        frameBlocks = 0;
+        frameUploads = 0;
+        stream.beginFrame();
+        fenceWaits = stream.fenceWaits;
+    }
+
+    // copy one block into the frame; returns the offset to bind, or -1 when the frame is full
+    GLintptr push(const void* block)
+    {
+        if (frameBlocks >= maxBlocks)
+        {
+            std::cout << "WARNING::UNIFORM_RING: more than " << maxBlocks << " blocks in a frame" << std::endl;
+            return -1;
+        }
+        GLintptr offset = frameBlocks * stride;
+        frameBlocks++;
+        if (persistent)
+            std::memcpy(stream.mapping() + offset, block, blockSize);
+        else
+            std::memcpy(staging.data() + offset, block, blockSize);
+        return stream.regionStart() + offset;
+    }
+
+    // make the frame's blocks visible to the GPU; call once after the last push()
+    void flush()
+    {
+        // the persistent mapping is coherent, nothing to do
+        if (persistent || frameBlocks == 0)
+            return;
+        stream.write(staging.data(), frameBlocks * stride);
+        frameUploads = stream.frameUploads;
+        uploads += frameUploads;
+    }
+
+    void bind(GLintptr offset) const
+    {
+        glState.bindBufferRange(GL_UNIFORM_BUFFER, binding, stream.buffer(), offset, blockSize);
+    }
+
+    // fence the region once every draw that reads it has been submitted
+    void endFrame()
+    {
+        stream.endFrame();
+    }
+
+    // free the fences and the storage; needs a current GL context
+    void release()
+    {
+        stream.release();
+    }
+
+private:
+    GLuint binding;
+    GLsizeiptr blockSize;
+    unsigned int maxBlocks;
+    GLsizeiptr stride;
+    StreamBuffer stream;
+    std::vector<char> staging;
+
+    static GLsizeiptr uniformAlignment()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        return alignment;
+    }
+
+    static GLsizeiptr alignedStride(GLsizeiptr blockSize)
+    {
+        GLsizeiptr alignment = uniformAlignment();
+        return (blockSize + alignment - 1) / alignment * alignment;
+    }
+};
+
+#endif /* uniform_ring_h */
@@ -0,0 +1,87 @@
+//
+//  vertex_format.h
+//  3D Object Drawing
+//
+//  Vertex layouts as data: a VertexLayout lists each attribute's location,
+//  component count, GL type and byte offset, and apply() turns it into the
+//  glVertexAttribPointer calls on the bound VAO. The packing helpers are
+//  the compact encodings the layouts refer to: snorm 10-10-10-2 normals,
+//  half-float texture coordinates and positions, unorm8 colors.
+//
+
+#ifndef vertex_format_h
+#define vertex_format_h
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct VertexAttribute
+{
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized; // integer types read as [0, 1] or [-1, 1]
+    size_t offset;        // bytes from the start of the vertex
+};
+
+struct VertexLayout
+{
+    GLsizei stride = 0; // bytes per vertex
+    std::vector<VertexAttribute> attributes;
+
+    VertexLayout(GLsizei stride) : stride(stride)
+    {
+    }
+
+    VertexLayout& add(GLuint location, GLint components, GLenum type, GLboolean normalized, size_t offset)
+    {
+        attributes.push_back({location, components, type, normalized, offset});
+        return *this;
+    }
+
+    // point and enable every attribute on the bound VAO, reading the bound
+    // GL_ARRAY_BUFFER from baseOffset on
+    void apply(size_t baseOffset = 0) const
+    {
+        for (const VertexAttribute& attribute : attributes)
+        {
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  stride, (void*)(baseOffset + attribute.offset));
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+};
+
+// unit vector as snorm x, y, z in 10 bits each (GL_INT_2_10_10_10_REV); w is 0
+inline uint32_t packNormal(const glm::vec3& normal)
+{
+    float length = glm::length(normal);
+    glm::vec3 unit = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    return glm::packSnorm3x10_1x2(glm::vec4(unit, 0.0f));
+}
+
+// two halves (GL_HALF_FLOAT); about three decimal digits, enough for texture coordinates
+inline uint32_t packTexCoord(const glm::vec2& texCoord)
+{
+    return glm::packHalf2x16(texCoord);
+}
+
+// four halves (GL_HALF_FLOAT) with w = 1; only for small local-space meshes,
+// the step at 1.0 is about 0.0005
+inline uint64_t packPosition(const glm::vec3& position)
+{
+    return glm::packHalf4x16(glm::vec4(position, 1.0f));
+}
+
+// rgba as unorm8 (GL_UNSIGNED_BYTE, normalized); components are clamped to [0, 1]
+inline uint32_t packColor(const glm::vec4& color)
+{
+    return glm::packUnorm4x8(color);
+}
+
+#endif /* vertex_format_h */